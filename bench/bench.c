@@ -0,0 +1,580 @@
+/*
+  Benchmark harness: runs each pipeline stage and the whole archive path
+  over generated corpora and prints the results as JSON, one object per
+  (corpus, size, threads) case. Every case runs in its own child process
+  so its peak RSS is its own. Throughputs are decimal MB/s of original
+  data, the best of --reps runs.
+
+    bench [--quick] [--corpus text,binary,random,repetitive] [--sizes 65536,1048576]
+          [--threads 1,4] [--block BYTES] [--reps N] [--out FILE]
+*/
+#include "bwt.h"
+#include "file_manager.h"
+#include "huffman.h"
+#include "mtf.h"
+#include "pipeline.h"
+#include "rle.h"
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LIST 16
+
+typedef struct
+{
+    const char *corpora[MAX_LIST];
+    int corpus_count;
+    size_t sizes[MAX_LIST];
+    int size_count;
+    int threads[MAX_LIST];
+    int thread_count;
+    size_t block_size;
+    int reps;
+} bench_options_t;
+
+// Stages in pipeline order, then their inverses
+enum
+{
+    STAGE_BWT_FORWARD,
+    STAGE_MTF_ENCODE,
+    STAGE_RLE_ENCODE,
+    STAGE_HUFFMAN_ENCODE,
+    STAGE_HUFFMAN_DECODE,
+    STAGE_RLE_DECODE,
+    STAGE_MTF_DECODE,
+    STAGE_BWT_INVERSE,
+    STAGE_COUNT
+};
+
+static const char *const stage_names[STAGE_COUNT] = {
+    "bwt_forward", "mtf_encode", "rle_encode", "huffman_encode",
+    "huffman_decode", "rle_decode", "mtf_decode", "bwt_inverse",
+};
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double mb_per_second(size_t bytes, double seconds)
+{
+    return seconds > 0 ? (double)bytes / seconds / 1e6 : 0;
+}
+
+// xorshift64*: the corpora are the same on every run and machine
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static void generate_text(uint8_t *data, size_t size, uint64_t *rng)
+{
+    static const char *const words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be", "by",
+        "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had",
+        "they", "you", "were", "block", "archive", "transform", "buffer", "thread", "sorting", "suffix",
+        "compression", "entropy", "stream", "header", "directory", "record", "checksum", "worker",
+    };
+    const size_t word_count = sizeof(words) / sizeof(words[0]);
+    size_t pos = 0;
+    size_t in_line = 0;
+    while (pos < size)
+    {
+        // Squaring a uniform pick skews it towards the common words, roughly like English
+        uint64_t r = next_random(rng) % word_count;
+        const char *word = words[r * r / word_count];
+        for (const char *c = word; *c && pos < size; c++)
+        {
+            data[pos++] = (uint8_t)*c;
+        }
+        if (pos < size)
+        {
+            data[pos++] = (++in_line % 12 == 0) ? '\n' : (next_random(rng) % 10 == 0 ? ',' : ' ');
+        }
+    }
+}
+
+// Fixed-size records with a counter, a small type code and slowly drifting measurements
+static void generate_binary(uint8_t *data, size_t size, uint64_t *rng)
+{
+    float level = 20.0f;
+    for (size_t pos = 0, id = 0; pos < size; id++)
+    {
+        uint8_t record[32];
+        memset(record, 0, sizeof(record));
+        uint32_t id32 = (uint32_t)id;
+        uint16_t type = (uint16_t)(next_random(rng) % 6);
+        level += (float)((int)(next_random(rng) % 21) - 10) * 0.01f;
+        float sample = level + (float)(next_random(rng) % 100) * 0.001f;
+        memcpy(record, &id32, sizeof(id32));
+        memcpy(record + 4, &type, sizeof(type));
+        memcpy(record + 8, &level, sizeof(level));
+        memcpy(record + 12, &sample, sizeof(sample));
+        size_t n = size - pos < sizeof(record) ? size - pos : sizeof(record);
+        memcpy(data + pos, record, n);
+        pos += n;
+    }
+}
+
+static void generate_random(uint8_t *data, size_t size, uint64_t *rng)
+{
+    for (size_t pos = 0; pos < size; pos++)
+    {
+        data[pos] = (uint8_t)(next_random(rng) >> 56);
+    }
+}
+
+// One short phrase over and over, with a rare mutation
+static void generate_repetitive(uint8_t *data, size_t size, uint64_t *rng)
+{
+    uint8_t phrase[997];
+    generate_random(phrase, sizeof(phrase), rng);
+    for (size_t pos = 0; pos < size; pos++)
+    {
+        data[pos] = phrase[pos % sizeof(phrase)];
+        if (next_random(rng) % 4096 == 0)
+        {
+            data[pos] ^= 0x55;
+        }
+    }
+}
+
+static int generate_corpus(const char *name, uint8_t *data, size_t size)
+{
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    if (strcmp(name, "text") == 0)
+    {
+        generate_text(data, size, &rng);
+    }
+    else if (strcmp(name, "binary") == 0)
+    {
+        generate_binary(data, size, &rng);
+    }
+    else if (strcmp(name, "random") == 0)
+    {
+        generate_random(data, size, &rng);
+    }
+    else if (strcmp(name, "repetitive") == 0)
+    {
+        generate_repetitive(data, size, &rng);
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+  Times each stage of the default pipeline block by block, encoding then
+  decoding every block so the working set stays one block. Fills
+  best[stage] with the fastest total over the repetitions and returns the
+  encoded size, or 0 when a stage fails or the data does not round-trip.
+*/
+static size_t run_stages(const uint8_t *data, size_t size, const bench_options_t *opts, int threads,
+                         double *best)
+{
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+    cfg.block_size = opts->block_size;
+    cfg.threads = threads;
+    size_t capacity = pipeline_max_encoded_size(PIPELINE_DEFAULT_STAGES, opts->block_size);
+    uint8_t *a = (uint8_t *)malloc(capacity);
+    uint8_t *b = (uint8_t *)malloc(capacity);
+    bwt_context_t ctx;
+    bwt_context_init(&ctx);
+    size_t encoded_total = 0;
+    int ok = a && b;
+
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        best[s] = -1;
+    }
+    for (int rep = 0; ok && rep < opts->reps; rep++)
+    {
+        double total[STAGE_COUNT] = {0};
+        encoded_total = 0;
+        for (size_t offset = 0; ok && offset < size; offset += opts->block_size)
+        {
+            size_t len = size - offset < opts->block_size ? size - offset : opts->block_size;
+            const uint8_t *block = data + offset;
+            size_t chain_index[BWT_MAX_CHAINS];
+            size_t chains = bwt_chain_count(len, cfg.chains);
+            size_t rle_len = capacity;
+            size_t huff_len = capacity;
+            size_t out_len = capacity;
+            double t0 = now_seconds();
+            ok = bwt_forward_chains_ctx(&ctx, &cfg, block, len, a, chain_index, cfg.chains) == BWT_STATUS_OK;
+            double t1 = now_seconds();
+            mtf_encode(a, len, b);
+            double t2 = now_seconds();
+            rle_encode_escaped(b, len, a, &rle_len);
+            double t3 = now_seconds();
+            ok = ok && huffman_encode(a, rle_len, b, &huff_len) == 0;
+            double t4 = now_seconds();
+            ok = ok && huffman_decode(b, huff_len, a, &out_len) == 0 && out_len == rle_len;
+            double t5 = now_seconds();
+            out_len = capacity;
+            rle_decode_escaped(a, rle_len, b, &out_len);
+            double t6 = now_seconds();
+            ok = ok && out_len == len;
+            mtf_decode(b, len, a);
+            double t7 = now_seconds();
+            ok = ok && bwt_inverse_chains_ctx(&ctx, &cfg, a, len, chain_index, chains, b) == BWT_STATUS_OK;
+            double t8 = now_seconds();
+            ok = ok && memcmp(b, block, len) == 0;
+
+            const double stamps[STAGE_COUNT + 1] = {t0, t1, t2, t3, t4, t5, t6, t7, t8};
+            for (int s = 0; s < STAGE_COUNT; s++)
+            {
+                total[s] += stamps[s + 1] - stamps[s];
+            }
+            encoded_total += huff_len;
+        }
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            if (best[s] < 0 || total[s] < best[s])
+            {
+                best[s] = total[s];
+            }
+        }
+    }
+
+    bwt_context_free(&ctx);
+    free(a);
+    free(b);
+    return ok ? encoded_total : 0;
+}
+
+static int write_file(const char *path, const uint8_t *data, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return -1;
+    }
+    int ok = fwrite(data, 1, size, file) == size;
+    return (fclose(file) == 0 && ok) ? 0 : -1;
+}
+
+static int same_file(const char *path, const uint8_t *data, size_t size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+    uint8_t *copy = (uint8_t *)malloc(size ? size : 1);
+    int same = copy && fread(copy, 1, size, file) == size && fgetc(file) == EOF && memcmp(copy, data, size) == 0;
+    free(copy);
+    fclose(file);
+    return same;
+}
+
+// Compresses and decompresses the corpus as a file through the archive API
+static int run_archive(const uint8_t *data, size_t size, const bench_options_t *opts, int threads,
+                       double *compress_seconds, double *decompress_seconds, uint64_t *archive_bytes)
+{
+    char dir[] = "/tmp/bench_XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        return -1;
+    }
+    char input[64];
+    char archive[64];
+    char output[64];
+    char extracted[80];
+    snprintf(input, sizeof(input), "%s/corpus", dir);
+    snprintf(archive, sizeof(archive), "%s/corpus.w", dir);
+    snprintf(output, sizeof(output), "%s/out", dir);
+    snprintf(extracted, sizeof(extracted), "%s/corpus", output);
+
+    fm_config_t cfg;
+    fm_config_init(&cfg);
+    cfg.bwt.block_size = opts->block_size;
+    cfg.bwt.threads = threads;
+    cfg.context = fm_context_create();
+
+    int ok = cfg.context && write_file(input, data, size) == 0;
+    *compress_seconds = -1;
+    *decompress_seconds = -1;
+    for (int rep = 0; ok && rep < opts->reps; rep++)
+    {
+        double t0 = now_seconds();
+        ok = fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK;
+        double t1 = now_seconds();
+        ok = ok && fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK;
+        double t2 = now_seconds();
+        ok = ok && same_file(extracted, data, size);
+        if (*compress_seconds < 0 || t1 - t0 < *compress_seconds)
+        {
+            *compress_seconds = t1 - t0;
+        }
+        if (*decompress_seconds < 0 || t2 - t1 < *decompress_seconds)
+        {
+            *decompress_seconds = t2 - t1;
+        }
+    }
+    struct stat st;
+    *archive_bytes = (ok && stat(archive, &st) == 0) ? (uint64_t)st.st_size : 0;
+
+    fm_context_destroy(cfg.context);
+    unlink(extracted);
+    rmdir(output);
+    unlink(archive);
+    unlink(input);
+    rmdir(dir);
+    return ok ? 0 : -1;
+}
+
+// Body of one case, run in the child; prints the JSON members of its result object
+static int run_case(FILE *out, const char *corpus, size_t size, int threads, const bench_options_t *opts)
+{
+    omp_set_num_threads(threads);
+    omp_set_max_active_levels(2); // as the CLI does: the child runs one call at a time
+    uint8_t *data = (uint8_t *)malloc(size ? size : 1);
+    if (!data || generate_corpus(corpus, data, size) != 0)
+    {
+        return -1;
+    }
+
+    double best[STAGE_COUNT];
+    size_t encoded = run_stages(data, size, opts, threads, best);
+    double compress_seconds;
+    double decompress_seconds;
+    uint64_t archive_bytes;
+    int archived = run_archive(data, size, opts, threads, &compress_seconds, &decompress_seconds, &archive_bytes);
+    free(data);
+    if (encoded == 0 || archived != 0)
+    {
+        return -1;
+    }
+
+    fprintf(out, "\"ratio\": %.4f, \"pipeline_bytes\": %zu, \"archive_bytes\": %llu, \"stages\": {",
+            (double)size / (double)archive_bytes, encoded, (unsigned long long)archive_bytes);
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        fprintf(out, "%s\"%s\": {\"seconds\": %.6f, \"mb_s\": %.2f}", s ? ", " : "", stage_names[s], best[s],
+                mb_per_second(size, best[s]));
+    }
+    fprintf(out, "}, \"fm_compress\": {\"seconds\": %.6f, \"mb_s\": %.2f}", compress_seconds,
+            mb_per_second(size, compress_seconds));
+    fprintf(out, ", \"fm_decompress\": {\"seconds\": %.6f, \"mb_s\": %.2f}", decompress_seconds,
+            mb_per_second(size, decompress_seconds));
+    return 0;
+}
+
+/*
+  Forks one case and relays its JSON, adding the child's peak RSS from
+  wait4. The parent never enters OpenMP, so each child starts with a
+  fresh runtime sized by its own thread count.
+*/
+static int fork_case(FILE *out, const char *corpus, size_t size, int threads, const bench_options_t *opts)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return -1;
+    }
+    fflush(out);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        FILE *result = fdopen(fds[1], "w");
+        int status = result ? run_case(result, corpus, size, threads, opts) : -1;
+        if (result)
+        {
+            fclose(result);
+        }
+        _exit(status == 0 ? 0 : 1);
+    }
+
+    close(fds[1]);
+    char body[4096];
+    size_t len = 0;
+    ssize_t got;
+    while ((got = read(fds[0], body + len, sizeof(body) - 1 - len)) > 0)
+    {
+        len += (size_t)got;
+    }
+    close(fds[0]);
+    body[len] = '\0';
+
+    int wstatus = 0;
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    int ok = wait4(pid, &wstatus, 0, &usage) == pid && WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+    fprintf(out, "    {\"corpus\": \"%s\", \"size\": %zu, \"threads\": %d, ", corpus, size, threads);
+    if (ok)
+    {
+        fprintf(out, "\"peak_rss_kb\": %ld, %s}", usage.ru_maxrss, body);
+    }
+    else
+    {
+        fprintf(out, "\"error\": \"case failed\"}");
+    }
+    return ok ? 0 : -1;
+}
+
+// Splits a comma-separated list; returns the number of items or -1 when there are too many
+static int split_list(char *arg, char **items)
+{
+    int count = 0;
+    for (char *item = strtok(arg, ","); item; item = strtok(NULL, ","))
+    {
+        if (count == MAX_LIST)
+        {
+            return -1;
+        }
+        items[count++] = item;
+    }
+    return count;
+}
+
+static int parse_options(int argc, char **argv, bench_options_t *opts, const char **out_path)
+{
+    static const char *const default_corpora[] = {"text", "binary", "random", "repetitive"};
+    memset(opts, 0, sizeof(*opts));
+    for (int i = 0; i < 4; i++)
+    {
+        opts->corpora[opts->corpus_count++] = default_corpora[i];
+    }
+    opts->sizes[opts->size_count++] = 64 * 1024;
+    opts->sizes[opts->size_count++] = 1024 * 1024;
+    opts->sizes[opts->size_count++] = 8 * 1024 * 1024;
+    opts->threads[opts->thread_count++] = 1;
+    int procs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (procs > 1)
+    {
+        opts->threads[opts->thread_count++] = procs;
+    }
+    opts->block_size = 1024 * 1024;
+    opts->reps = 3;
+    *out_path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        char *items[MAX_LIST];
+        const char *arg = argv[i];
+        char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--quick") == 0)
+        {
+            opts->size_count = 2;
+            opts->reps = 1;
+            continue;
+        }
+        if (!value)
+        {
+            return -1;
+        }
+        i++;
+        if (strcmp(arg, "--out") == 0)
+        {
+            *out_path = value;
+        }
+        else if (strcmp(arg, "--block") == 0)
+        {
+            opts->block_size = (size_t)strtoull(value, NULL, 10);
+        }
+        else if (strcmp(arg, "--reps") == 0)
+        {
+            opts->reps = atoi(value);
+        }
+        else if (strcmp(arg, "--corpus") == 0 && (opts->corpus_count = split_list(value, items)) > 0)
+        {
+            for (int c = 0; c < opts->corpus_count; c++)
+            {
+                opts->corpora[c] = items[c];
+            }
+        }
+        else if (strcmp(arg, "--sizes") == 0 && (opts->size_count = split_list(value, items)) > 0)
+        {
+            for (int c = 0; c < opts->size_count; c++)
+            {
+                opts->sizes[c] = (size_t)strtoull(items[c], NULL, 10);
+            }
+        }
+        else if (strcmp(arg, "--threads") == 0 && (opts->thread_count = split_list(value, items)) > 0)
+        {
+            for (int c = 0; c < opts->thread_count; c++)
+            {
+                opts->threads[c] = atoi(items[c]);
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return (opts->block_size > 0 && opts->reps > 0) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t opts;
+    const char *out_path;
+    if (parse_options(argc, argv, &opts, &out_path) != 0)
+    {
+        fprintf(stderr,
+                "usage: %s [--quick] [--corpus LIST] [--sizes LIST] [--threads LIST] [--block BYTES] "
+                "[--reps N] [--out FILE]\n",
+                argv[0]);
+        return 2;
+    }
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out)
+    {
+        perror(out_path);
+        return 1;
+    }
+
+    time_t started = time(NULL);
+    fprintf(out, "{\n  \"benchmark\": \"file_compressor\",\n  \"started\": %lld,\n  \"cpus\": %ld,\n",
+            (long long)started, sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(out, "  \"block_size\": %zu,\n  \"reps\": %d,\n  \"results\": [\n", opts.block_size, opts.reps);
+    int failures = 0;
+    int first = 1;
+    for (int c = 0; c < opts.corpus_count; c++)
+    {
+        for (int s = 0; s < opts.size_count; s++)
+        {
+            for (int t = 0; t < opts.thread_count; t++)
+            {
+                if (!first)
+                {
+                    fprintf(out, ",\n");
+                }
+                first = 0;
+                failures += fork_case(out, opts.corpora[c], opts.sizes[s], opts.threads[t], &opts) != 0;
+                if (out != stdout)
+                {
+                    fprintf(stderr, "%s %zu bytes, %d threads\n", opts.corpora[c], opts.sizes[s], opts.threads[t]);
+                }
+            }
+        }
+    }
+    fprintf(out, "\n  ],\n  \"failures\": %d\n}\n", failures);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return failures ? 1 : 0;
+}
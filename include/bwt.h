@@ -11,16 +11,70 @@ typedef enum {
     BWT_STATUS_INTERNAL_ERROR = -3
 } bwt_status_t;
 
+typedef enum {
+    BWT_ENGINE_SAIS = 0,            /* linear-time induced sorting (default) */
+    BWT_ENGINE_PREFIX_DOUBLING = 1  /* O(n log^2 n) rank doubling */
+} bwt_engine_t;
+
+#define BWT_MAX_CHAINS 256
+
 typedef struct {
     size_t block_size;
-    int threads;
+    int threads; /* team size of each transform, 0 for the OpenMP default */
+    bwt_engine_t engine;
+    size_t chains; /* LF chains recorded per block for the interleaved inverse */
+    size_t in_flight; /* blocks the stream API buffers between its read, transform and
+                         write stages; 1 (default) runs them in turn on the calling thread */
+    size_t inverse_memory; /* cap on the inverse's per-block table in bytes, 0 for none.
+                              Under it the inverse drops to a 32-bit LF table, then to
+                              symbol counts sampled as sparsely as the cap needs
+                              (slower; from 4 down to 1/64 bytes per byte) */
 } bwt_config_t;
 
+/*
+  Workspace reused across transforms: it grows to the largest block seen
+  and keeps that allocation, so a run of blocks pays for it once. Not
+  thread-safe; give each worker its own.
+*/
+typedef struct {
+    uint8_t *base;
+    size_t capacity;
+    size_t used;
+    /* Counters since the context was initialized, for instrumentation */
+    size_t allocations;     /* workspace growths and requests it could not carve */
+    size_t doubling_rounds; /* prefix-doubling sort passes */
+} bwt_context_t;
+
 void bwt_config_init(bwt_config_t *cfg);
+void bwt_context_init(bwt_context_t *ctx);
+void bwt_context_free(bwt_context_t *ctx);
+/* Bytes held by ctx, which is also the most any transform has needed from it. */
+size_t bwt_context_high_water(const bwt_context_t *ctx);
+size_t bwt_forward_workspace_bytes(const bwt_config_t *cfg, size_t length);
+size_t bwt_inverse_workspace_bytes(const bwt_config_t *cfg, size_t length);
+bwt_status_t bwt_forward_ex(const bwt_config_t *cfg, const uint8_t *input, size_t length,
+                            uint8_t *output, size_t *primary_index);
 bwt_status_t bwt_forward(const uint8_t *input, size_t length,
                          uint8_t *output, size_t *primary_index);
 bwt_status_t bwt_inverse(const uint8_t *input, size_t length,
                          size_t primary_index, uint8_t *output);
+size_t bwt_chain_count(size_t length, size_t chains);
+bwt_status_t bwt_forward_chains(const bwt_config_t *cfg, const uint8_t *input, size_t length,
+                                uint8_t *output, size_t *chain_index, size_t chains);
+bwt_status_t bwt_inverse_chains(const bwt_config_t *cfg, const uint8_t *input, size_t length,
+                                const size_t *chain_index, size_t chains, uint8_t *output);
+bwt_status_t bwt_forward_chains_ctx(bwt_context_t *ctx, const bwt_config_t *cfg, const uint8_t *input,
+                                    size_t length, uint8_t *output, size_t *chain_index, size_t chains);
+bwt_status_t bwt_inverse_chains_ctx(bwt_context_t *ctx, const bwt_config_t *cfg, const uint8_t *input,
+                                    size_t length, const size_t *chain_index, size_t chains, uint8_t *output);
+/*
+  The forward functions accept output == input. bwt_forward_in_place()
+  transforms data where it lies, e.g. a block buffer or a private mapping,
+  with no buffer beyond the suffix array workspace from ctx (NULL: a
+  temporary one). No sentinel is appended; primary_index marks the row.
+*/
+bwt_status_t bwt_forward_in_place(bwt_context_t *ctx, const bwt_config_t *cfg, uint8_t *data,
+                                  size_t length, size_t *primary_index);
 bwt_status_t bwt_forward_alloc(const uint8_t *input, size_t length,
                                uint8_t **output, size_t *primary_index);
 bwt_status_t bwt_inverse_alloc(const uint8_t *input, size_t length,
@@ -30,6 +84,13 @@ typedef int (*bwt_write_cb)(void *user_ctx, const uint8_t *buffer,
                             size_t length, size_t primary_index);
 typedef size_t (*bwt_read_block_cb)(void *user_ctx, uint8_t *buffer,
                                     size_t max_len, size_t *primary_index);
+/*
+  Stream API: blocks of cfg->block_size pass from reader through the
+  transform to writer, in order. With the default in_flight of 1 both
+  callbacks run on the calling thread, one at a time. With in_flight > 1
+  they run on helper threads, concurrently with each other and with the
+  transform, so they must be thread-safe and share no unsynchronized state.
+*/
 bwt_status_t bwt_forward_stream(const bwt_config_t *cfg,
                                 bwt_read_cb reader, void *reader_ctx,
                                 bwt_write_cb writer, void *writer_ctx);
@@ -0,0 +1,10 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli) of data, continuing from a previous result (0 to start)
+uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t length);
+
+#endif // CRC32C_H
@@ -0,0 +1,60 @@
+#ifndef FILE_IO_H
+#define FILE_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only mapping of a whole regular file, consumed front to back
+typedef struct {
+    const uint8_t *data; // NULL when nothing is mapped
+    size_t size;
+} io_map_t;
+
+// Maps the regular file behind fd for one sequential pass. Returns 0 on
+// success and -1 when the descriptor cannot be mapped (pipes, terminals,
+// empty files), in which case callers fall back to buffered reads.
+int io_map_fd(int fd, io_map_t *map);
+
+// Drops the pages of [offset, offset + length) once they have been consumed,
+// so mapping a file larger than RAM does not pin it in the process.
+void io_map_release(const io_map_t *map, size_t offset, size_t length);
+
+void io_unmap(io_map_t *map);
+
+// Writes the whole buffer at offset, retrying short writes. Returns 0 on success.
+int io_pwrite_all(int fd, const uint8_t *buffer, size_t length, uint64_t offset);
+
+// Makes dst_fd a copy of the regular file behind src_fd. The copy shares
+// extents with the source (FICLONE) where the filesystem supports reflinks,
+// otherwise it is copied in the kernel, then through a buffer as a last
+// resort. Returns 0 on success.
+int io_copy_file(int dst_fd, int src_fd);
+
+// How io_read_batch issues its reads
+typedef enum {
+    IO_BACKEND_AUTO,    // io_uring where the kernel allows it, else the thread pool
+    IO_BACKEND_URING,   // opens and reads submitted to one io_uring
+    IO_BACKEND_THREADS, // blocking open and pread on a small pool of threads
+    IO_BACKEND_SYNC     // one read after another on the calling thread
+} io_backend_t;
+
+// One read of [offset, offset + length); 'path' is opened and closed again when fd < 0
+typedef struct {
+    const char *path;
+    int fd;
+    uint8_t *buffer;
+    size_t length;
+    uint64_t offset;
+    int result; // 1 read in full, 0 short read or error, -1 the file could not be opened
+} io_read_t;
+
+// Performs one read on the calling thread and returns its result
+int io_read_one(io_read_t *read);
+
+// Performs every read with up to 'depth' of them in flight, so opening and
+// reading many small files is not one round trip after another. A backend
+// the system refuses falls back to the next one down. Returns the backend
+// that ran the reads.
+io_backend_t io_read_batch(io_read_t *reads, size_t count, unsigned depth, io_backend_t backend);
+
+#endif // FILE_IO_H
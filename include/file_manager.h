@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "bwt.h"
+#include "file_io.h"
 
 typedef enum {
     FM_STATUS_OK = 0,
@@ -13,6 +15,59 @@ typedef enum {
     FM_STATUS_IO_ERROR = 5
 } fm_status_t;
 
+// Workspace reused across calls: block buffers and BWT scratch grow to the
+// largest block seen and stay allocated until fm_context_destroy
+typedef struct fm_context fm_context_t;
+
+// Pipeline stages reported by fm_stats_t, in stage order: BWT, MTF, RLE, Huffman
+#define FM_STATS_STAGES 4
+
+// What one compress or decompress call did and where its time went
+typedef struct {
+    double seconds;       // wall time of the call
+    double read_seconds;  // loading input files, or parsing archive records
+    double write_seconds; // appending to the archive, or writing extracted files
+    double stage_seconds[FM_STATS_STAGES]; // summed over blocks, so over threads too
+    uint64_t stage_bytes_in[FM_STATS_STAGES];
+    uint64_t stage_bytes_out[FM_STATS_STAGES];
+    uint64_t original_bytes; // uncompressed bytes through the pipeline
+    uint64_t archive_bytes;  // archive bytes written or read
+    uint64_t files;          // entries written or extracted, links included
+    uint64_t blocks;
+    uint64_t stored_blocks;   // blocks kept as they were: incompressible by scan or by result
+    uint64_t rle_blocks;      // blocks the scan sent through RLE without the BWT
+    uint64_t allocations;     // BWT workspace allocations
+    uint64_t allocated_bytes; // buffers and workspace the call added to its fm_context_t
+    uint64_t doubling_rounds; // prefix-doubling passes (BWT_ENGINE_PREFIX_DOUBLING)
+    int threads;              // workers the call ran with, after fitting its memory limit
+    uint64_t memory_limit;    // limit the call was planned against, FM_MEMORY_UNLIMITED if none
+} fm_stats_t;
+
+// Name of stage i of fm_stats_t, e.g. "bwt"
+const char *fm_stats_stage_name(int stage);
+
+// fm_config_t.memory_limit value that turns the limit off
+#define FM_MEMORY_UNLIMITED UINT64_MAX
+
+typedef struct {
+    bwt_config_t bwt;      // block_size splits each file; threads bounds the threads of a call, shared
+                           // between blocks and, with nested OpenMP enabled, the transform of each
+    uint32_t stages;       // pipeline_stage_t mask applied to every block
+    int adaptive;          // let a scan of each block pick a subset of stages (pipeline_choose_stages)
+                           // and widen blocks of large files that it keeps from the BWT
+    size_t solid_max_file; // files up to this size share solid blocks; 0 disables solid mode
+    int dedup;             // store files identical to an earlier one as references to it
+    unsigned io_depth;     // file reads kept in flight while a batch loads; 0 or 1 reads them in the workers
+    io_backend_t io_backend; // how those reads are issued
+    uint64_t memory_limit; // bytes a call may hold at once: fewer workers, smaller blocks or a slower
+                           // low-memory inverse keep it under; 0 reads the cgroup v2 memory.max
+    fm_context_t *context; // reused by every call given this config; NULL allocates per call
+    fm_stats_t *stats;     // when set, each call that gets to its data overwrites it with its figures
+} fm_config_t;
+
+// Entry name given to data compressed from standard input
+#define FM_STDIN_ENTRY "stdin"
+
 typedef enum {
     FM_TYPE_FILE,
     FM_TYPE_DIRECTORY
@@ -21,10 +76,47 @@ typedef enum {
 // Detects whether the path is a file or directory
 fm_path_type_t fm_get_path_type(const char *path);
 
+// Tightest cgroup v2 memory.max on the path from the cgroup named on the
+// "0::" line of proc_cgroup up to the root of the hierarchy mounted at
+// root, or FM_MEMORY_UNLIMITED when none is set. NULL selects
+// /proc/self/cgroup and /sys/fs/cgroup, which fm_config_t.memory_limit 0 reads.
+uint64_t fm_cgroup_memory_max(const char *proc_cgroup, const char *root);
+
+// Fills cfg with the defaults used by fm_compress
+void fm_config_init(fm_config_t *cfg);
+
+// A context may serve any number of calls, one at a time
+fm_context_t *fm_context_create(void);
+void fm_context_destroy(fm_context_t *ctx);
+
+// Bytes the context holds, which is also the most any call has needed from it
+size_t fm_context_high_water(const fm_context_t *ctx);
+
 // Compresses a file or directory and stores the result in a .w file
 fm_status_t fm_compress(const char *input_path, const char *output_path);
 
+// Same as fm_compress with explicit block size, engine and thread settings.
+// input_path "-" reads stdin and output_path "-" writes stdout.
+fm_status_t fm_compress_ex(const char *input_path, const char *output_path, const fm_config_t *cfg);
+
+// Compresses everything reader yields as one entry named entry_name. The input
+// is read sequentially in blocks and never sized up front, so memory stays
+// bounded for pipes and inputs larger than RAM.
+fm_status_t fm_compress_stream(bwt_read_cb reader, void *reader_ctx, const char *entry_name,
+                               const char *output_path, const fm_config_t *cfg);
+
 // Decompresses a .w file
 fm_status_t fm_decompress(const char *input_path, const char *output_path);
 
+// Same as fm_decompress with an explicit thread count for parallel block decoding.
+// input_path "-" reads the archive from stdin.
+fm_status_t fm_decompress_ex(const char *input_path, const char *output_path, const fm_config_t *cfg);
+
+// Extracts the single entry entry_path (as stored, e.g. "conf/app.ini") into
+// output_path/entry_path, or to stdout when output_path is "-". Seeks through
+// the archive's central directory instead of decoding earlier entries.
+// Returns FM_STATUS_FILE_NOT_FOUND when the archive has no such entry.
+fm_status_t fm_extract_one(const char *archive_path, const char *entry_path, const char *output_path,
+                           const fm_config_t *cfg);
+
 #endif // FILE_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest code length; the decoder resolves every symbol with one table lookup
+#define HUFFMAN_MAX_BITS 12
+
+// Worst-case encoded size: incompressible input is stored raw behind a small header
+size_t huffman_max_encoded_size(size_t input_size);
+
+// Canonical Huffman coding of a byte buffer. *output_size holds the output
+// capacity on entry and the encoded size on return. Returns 0 on success.
+int huffman_encode(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size);
+
+// *output_size holds the output capacity on entry and the decoded size on return.
+// Returns 0 on success, -1 on malformed input or insufficient capacity.
+int huffman_decode(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size);
+
+#endif // HUFFMAN_H
@@ -0,0 +1,11 @@
+#ifndef MTF_H
+#define MTF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Move-to-front transform: output has the same size as the input
+void mtf_encode(const uint8_t *input, size_t input_size, uint8_t *output);
+void mtf_decode(const uint8_t *input, size_t input_size, uint8_t *output);
+
+#endif // MTF_H
@@ -0,0 +1,83 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bwt.h"
+
+// Block transform stages, applied in this order when present
+typedef enum {
+    PIPELINE_STAGE_BWT = 1u << 0,     // Burrows-Wheeler transform
+    PIPELINE_STAGE_MTF = 1u << 1,     // move-to-front
+    PIPELINE_STAGE_RLE = 1u << 2,     // escaped run-length encoding (bounded expansion)
+    PIPELINE_STAGE_HUFFMAN = 1u << 3  // canonical Huffman entropy coding
+} pipeline_stage_t;
+
+#define PIPELINE_STAGE_MASK (PIPELINE_STAGE_BWT | PIPELINE_STAGE_MTF | PIPELINE_STAGE_RLE | PIPELINE_STAGE_HUFFMAN)
+#define PIPELINE_DEFAULT_STAGES PIPELINE_STAGE_MASK
+#define PIPELINE_STAGE_COUNT 4
+
+typedef enum {
+    PIPELINE_STATUS_OK = 0,
+    PIPELINE_STATUS_INVALID_ARGUMENT = -1,
+    PIPELINE_STATUS_ALLOCATION_FAILURE = -2,
+    PIPELINE_STATUS_CORRUPT_DATA = -3
+} pipeline_status_t;
+
+// Per-block metadata the container must store to decode the block again
+typedef struct {
+    uint32_t stages;
+    size_t chain_count; // 0 when the BWT stage is absent
+    size_t chain_index[BWT_MAX_CHAINS];
+} pipeline_block_t;
+
+// Time and bytes per stage, indexed in stage order (BWT, MTF, RLE, Huffman).
+// The functions below add to it, so one instance can total many blocks.
+typedef struct {
+    double seconds[PIPELINE_STAGE_COUNT];
+    uint64_t bytes_in[PIPELINE_STAGE_COUNT];
+    uint64_t bytes_out[PIPELINE_STAGE_COUNT];
+    uint64_t allocations;     // BWT workspace allocations, from ctx
+    uint64_t doubling_rounds; // prefix-doubling passes, from ctx
+} pipeline_stats_t;
+
+// Capacity needed for the output and scratch buffers of a block of input_size bytes
+size_t pipeline_max_encoded_size(uint32_t stages, size_t input_size);
+
+// What a quick look at a sample of a block found
+typedef struct {
+    double entropy;     // order-0 entropy of the sampled bytes, in bits per byte
+    double run_density; // fraction of sampled bytes equal to the byte before them
+    double repeats;     // fraction of sampled 4-byte strings already seen in the sample
+    size_t distinct;    // byte values seen
+    size_t sampled;     // bytes looked at
+} pipeline_scan_t;
+
+// Samples up to PIPELINE_SCAN_SAMPLE bytes spread over the block; an empty
+// block scans as all zeros
+#define PIPELINE_SCAN_SAMPLE (64 * 1024)
+void pipeline_scan(const uint8_t *input, size_t input_size, pipeline_scan_t *scan);
+
+// Picks the stages worth running on a block out of 'stages', from a scan
+// of it: none (stored) for data with flat byte statistics and no repeats,
+// RLE and Huffman
+// without the BWT for data that is mostly runs, and all of 'stages' otherwise
+uint32_t pipeline_choose_stages(uint32_t stages, const uint8_t *input, size_t input_size);
+
+// Runs the stages over one block. output and scratch must each hold
+// pipeline_max_encoded_size(stages, input_size) bytes. The BWT stage draws
+// its workspace from ctx, or allocates it per call when ctx is NULL.
+// stats, when not NULL, accumulates the time and bytes of each stage.
+pipeline_status_t pipeline_encode(const bwt_config_t *cfg, bwt_context_t *ctx, uint32_t stages,
+                                  const uint8_t *input, size_t input_size,
+                                  uint8_t *output, size_t *output_size, uint8_t *scratch,
+                                  pipeline_block_t *block, pipeline_stats_t *stats);
+
+// Reverses the stages recorded in block. output and scratch must each hold
+// pipeline_max_encoded_size(block->stages, original_size) bytes.
+pipeline_status_t pipeline_decode(const bwt_config_t *cfg, bwt_context_t *ctx,
+                                  const pipeline_block_t *block, const uint8_t *input, size_t input_size,
+                                  uint8_t *output, size_t original_size, uint8_t *scratch,
+                                  pipeline_stats_t *stats);
+
+#endif // PIPELINE_H
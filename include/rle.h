@@ -4,7 +4,23 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Run-length encodings understood by this module
+typedef enum {
+    RLE_MODE_PAIRS = 0,  // (byte, count) pairs; doubles incompressible input
+    RLE_MODE_ESCAPED = 1 // literal/repeat packets; at most one extra byte per 128
+} rle_mode_t;
+
+// Shortest run the escaped mode codes as a repeat packet, and the longest
+#define RLE_MIN_RUN 3
+#define RLE_MAX_RUN (127 + RLE_MIN_RUN)
+
+// Exact worst-case encoded size of input_size bytes in the given mode
+size_t rle_max_encoded_size(rle_mode_t mode, size_t input_size);
+
 void rle_encode(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size);
 void rle_decode(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size);
 
-#endif // RLE_H
\ No newline at end of file
+void rle_encode_escaped(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size);
+void rle_decode_escaped(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size);
+
+#endif // RLE_H
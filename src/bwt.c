@@ -2,8 +2,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdint.h> 
 #include <stdio.h>  // binary file I/O
+#include <time.h>
 
 typedef struct {
     size_t index;
@@ -11,24 +15,228 @@ typedef struct {
     int rank1;
 } suffix_t;
 
-// Compare two suffixes by their ranks and index (works on binary bytes).
-static int suffix_compare(const void *a, const void *b) {
-    const suffix_t *sa = (const suffix_t *)a;
-    const suffix_t *sb = (const suffix_t *)b;
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1u << RADIX_BITS)
 
-    if (sa->rank0 != sb->rank0) {
-        return (sa->rank0 < sb->rank0) ? -1 : 1;
+/*
+  Context workspace: each transform reserves its whole working set once,
+  then carves its arrays off the front. Space is only reclaimed when the
+  next transform starts, so carving is a pointer bump. Requests that do
+  not fit fall back to malloc.
+*/
+#define BWT_WS_ALIGN 64
+#define BWT_WS_SLACK (128 * BWT_WS_ALIGN) /* alignment padding of the carved arrays */
+
+void bwt_context_init(bwt_context_t *ctx) {
+    if (ctx) {
+        ctx->base = NULL;
+        ctx->capacity = 0;
+        ctx->used = 0;
+        ctx->allocations = 0;
+        ctx->doubling_rounds = 0;
+    }
+}
+
+void bwt_context_free(bwt_context_t *ctx) {
+    if (ctx) {
+        free(ctx->base);
+        bwt_context_init(ctx);
     }
-    if (sa->rank1 != sb->rank1) {
-        return (sa->rank1 < sb->rank1) ? -1 : 1;
+}
+
+size_t bwt_context_high_water(const bwt_context_t *ctx) {
+    return ctx ? ctx->capacity : 0;
+}
+
+// Starts a transform needing up to 'bytes' of workspace, growing the context if needed.
+static void ws_begin(bwt_context_t *ctx, size_t bytes) {
+    ctx->used = 0;
+    if (bytes <= ctx->capacity) {
+        return;
     }
-    if (sa->index < sb->index) {
-        return -1;
+    size_t capacity = (bytes + BWT_WS_ALIGN - 1) & ~(size_t)(BWT_WS_ALIGN - 1);
+    ctx->allocations++;
+    free(ctx->base);
+    ctx->base = (uint8_t *)aligned_alloc(BWT_WS_ALIGN, capacity);
+    ctx->capacity = ctx->base ? capacity : 0;
+}
+
+static void *ws_alloc(bwt_context_t *ctx, size_t bytes) {
+    size_t size = (bytes + BWT_WS_ALIGN - 1) & ~(size_t)(BWT_WS_ALIGN - 1);
+    if (ctx->base && size <= ctx->capacity - ctx->used) {
+        void *block = ctx->base + ctx->used;
+        ctx->used += size;
+        return block;
     }
-    if (sa->index > sb->index) {
-        return 1;
+    ctx->allocations++;
+    return malloc(bytes ? bytes : 1);
+}
+
+// Frees what ws_alloc had to malloc; carved space waits for the next ws_begin.
+static void ws_free(bwt_context_t *ctx, void *block) {
+    const uint8_t *p = (const uint8_t *)block;
+    if (!ctx->base || p < ctx->base || p >= ctx->base + ctx->capacity) {
+        free(block);
+    }
+}
+
+// Number of radix passes needed to cover keys in [0, max_key].
+static int radix_passes(size_t max_key) {
+    int passes = 1;
+    while (max_key >>= RADIX_BITS) {
+        passes++;
+    }
+    return passes;
+}
+
+static inline size_t radix_key(const suffix_t *s, int use_rank0) {
+    /* rank1 is -1 past the end of the input; shift it so it sorts first. */
+    return use_rank0 ? (size_t)s->rank0 : (size_t)(s->rank1 + 1);
+}
+
+/*
+  Stable parallel LSD radix sort of suffixes by (rank0, rank1): rank1 digits
+  first, then rank0 digits. Each pass builds per-thread histograms over
+  static chunks, turns them into scatter offsets (digit-major, thread-minor)
+  and scatters in parallel. Passes whose digit is constant are skipped.
+  The sorted data ends up in *data; *tmp is scratch of the same size.
+*/
+static bwt_status_t radix_sort_suffixes(suffix_t **data, suffix_t **tmp, size_t length,
+                                        size_t max_rank0, size_t max_rank1) {
+    int nthreads = (length > 1024) ? omp_get_max_threads() : 1;
+    size_t *hist = (size_t *)malloc((size_t)nthreads * RADIX_BUCKETS * sizeof(size_t));
+    if (!hist) {
+        return BWT_STATUS_ALLOCATION_FAILURE;
+    }
+
+    const int key_passes[2] = { radix_passes(max_rank1 + 1), radix_passes(max_rank0) };
+
+    for (int use_rank0 = 0; use_rank0 < 2; ++use_rank0) {
+        for (int pass = 0; pass < key_passes[use_rank0]; ++pass) {
+            const int shift = pass * RADIX_BITS;
+            int skip = 0;
+            const suffix_t *src = *data;
+            suffix_t *dst = *tmp;
+
+#pragma omp parallel num_threads(nthreads)
+            {
+                int tid = omp_get_thread_num();
+                int team = omp_get_num_threads();
+                size_t lo = length * (size_t)tid / (size_t)team;
+                size_t hi = length * (size_t)(tid + 1) / (size_t)team;
+                size_t *local = hist + (size_t)tid * RADIX_BUCKETS;
+
+                memset(local, 0, RADIX_BUCKETS * sizeof(size_t));
+                for (size_t i = lo; i < hi; ++i) {
+                    local[(radix_key(&src[i], use_rank0) >> shift) & (RADIX_BUCKETS - 1)]++;
+                }
+
+#pragma omp barrier
+#pragma omp single
+                {
+                    size_t sum = 0;
+                    for (unsigned d = 0; d < RADIX_BUCKETS; ++d) {
+                        size_t digit_total = 0;
+                        for (int t = 0; t < team; ++t) {
+                            size_t c = hist[(size_t)t * RADIX_BUCKETS + d];
+                            hist[(size_t)t * RADIX_BUCKETS + d] = sum;
+                            sum += c;
+                            digit_total += c;
+                        }
+                        if (digit_total == length) {
+                            skip = 1;
+                        }
+                    }
+                }
+
+                if (!skip) {
+                    for (size_t i = lo; i < hi; ++i) {
+                        size_t d = (radix_key(&src[i], use_rank0) >> shift) & (RADIX_BUCKETS - 1);
+                        dst[local[d]++] = src[i];
+                    }
+                }
+            }
+
+            if (!skip) {
+                *tmp = *data;
+                *data = dst;
+            }
+        }
+    }
+
+    free(hist);
+    return BWT_STATUS_OK;
+}
+
+/*
+  Replace each rank0 by the dense rank of its (rank0, rank1) pair and record
+  index_to_pos. A parallel prefix sum over per-chunk "new pair" counts gives
+  every chunk its starting rank; the pair just before each chunk is captured
+  before anyone rewrites it. Returns the highest rank assigned.
+*/
+static size_t renumber_ranks(suffix_t *suffixes, size_t length, size_t *index_to_pos) {
+    int nthreads = (length > 1024) ? omp_get_max_threads() : 1;
+    size_t *chunk_base = (size_t *)calloc((size_t)nthreads + 1, sizeof(size_t));
+    size_t max_rank = 0;
+    if (!chunk_base) {
+        nthreads = 1; /* fall back to a single sequential chunk */
+        chunk_base = &max_rank;
+    }
+
+#pragma omp parallel num_threads(nthreads)
+    {
+        int tid = omp_get_thread_num();
+        int team = omp_get_num_threads();
+        size_t lo = length * (size_t)tid / (size_t)team;
+        size_t hi = length * (size_t)(tid + 1) / (size_t)team;
+
+        int prev_rank0 = (lo > 0) ? suffixes[lo - 1].rank0 : -1;
+        int prev_rank1 = (lo > 0) ? suffixes[lo - 1].rank1 : -2;
+        size_t changes = 0;
+        for (size_t i = lo; i < hi; ++i) {
+            if (suffixes[i].rank0 != prev_rank0 || suffixes[i].rank1 != prev_rank1) {
+                changes++;
+                prev_rank0 = suffixes[i].rank0;
+                prev_rank1 = suffixes[i].rank1;
+            }
+        }
+        if (team > 1) {
+            chunk_base[tid + 1] = changes;
+        }
+        int first_rank0 = (lo > 0) ? suffixes[lo - 1].rank0 : -1;
+        int first_rank1 = (lo > 0) ? suffixes[lo - 1].rank1 : -2;
+
+#pragma omp barrier
+#pragma omp single
+        {
+            if (team > 1) {
+                for (int t = 0; t < team; ++t) {
+                    chunk_base[t + 1] += chunk_base[t];
+                }
+                max_rank = chunk_base[team] - 1;
+            } else {
+                max_rank = changes - 1;
+            }
+        }
+
+        size_t rank = (team > 1) ? chunk_base[tid] : 0;
+        prev_rank0 = first_rank0;
+        prev_rank1 = first_rank1;
+        for (size_t i = lo; i < hi; ++i) {
+            if (suffixes[i].rank0 != prev_rank0 || suffixes[i].rank1 != prev_rank1) {
+                rank++;
+                prev_rank0 = suffixes[i].rank0;
+                prev_rank1 = suffixes[i].rank1;
+            }
+            suffixes[i].rank0 = (int)(rank - 1);
+            index_to_pos[suffixes[i].index] = i;
+        }
+    }
+
+    if (chunk_base != &max_rank) {
+        free(chunk_base);
     }
-    return 0;
+    return max_rank;
 }
 
 // Return clamped block size (default 1 MiB).
@@ -36,23 +244,263 @@ static inline size_t clamp_block_size(size_t block_size) {
     return block_size == 0 ? (1u << 20) : block_size; /* 1 MiB default */
 }
 
-// Perform forward BWT on a binary input buffer.
-// input/output are binary buffers of 'length' bytes. primary_index is the BWT primary index.
-static bwt_status_t bwt_forward_core(const uint8_t *input, size_t length,
-                                     uint8_t *output, size_t *primary_index,
-                                     int requested_threads) {
-    if (length == 0) {
-        if (primary_index) {
-            *primary_index = 0;
+/* SA-IS with 32-bit indices for blocks under 4 GiB, 64-bit otherwise. */
+#define SAIS_IDX uint32_t
+#define SAIS_EMPTY UINT32_MAX
+#define SAIS_FN(name) name##_32
+#include "sais_impl.h"
+#undef SAIS_IDX
+#undef SAIS_EMPTY
+#undef SAIS_FN
+
+#define SAIS_IDX size_t
+#define SAIS_EMPTY SIZE_MAX
+#define SAIS_FN(name) name##_64
+#include "sais_impl.h"
+#undef SAIS_IDX
+#undef SAIS_EMPTY
+#undef SAIS_FN
+
+// Threads one transform runs on: cfg->threads, or the caller's OpenMP default when 0.
+static int bwt_team_size(const bwt_config_t *cfg) {
+    return (cfg && cfg->threads > 0) ? cfg->threads : omp_get_max_threads();
+}
+
+// Blocks shorter than this use the compact 32-bit workspace layout.
+static inline int bwt_fits_32(size_t length) {
+    return length < (size_t)UINT32_MAX;
+}
+
+// Forward BWT using SA-IS suffix sorting.
+static bwt_status_t bwt_forward_sais(const uint8_t *input, size_t length, uint8_t *output,
+                                     size_t *chain_index, size_t stride, bwt_context_t *ctx) {
+    bwt_status_t status;
+
+    if (bwt_fits_32(length)) {
+        uint32_t *sa = (uint32_t *)ws_alloc(ctx, length * sizeof(uint32_t));
+        if (!sa) {
+            return BWT_STATUS_ALLOCATION_FAILURE;
         }
-        return BWT_STATUS_OK;
+        status = sais_main_32(input, sizeof(uint8_t), sa, length, 256, NULL, 0, ctx);
+        if (status == BWT_STATUS_OK) {
+            bwt_emit_32(input, length, sa, output, chain_index, stride);
+        }
+        ws_free(ctx, sa);
+    } else {
+        size_t *sa = (size_t *)ws_alloc(ctx, length * sizeof(size_t));
+        if (!sa) {
+            return BWT_STATUS_ALLOCATION_FAILURE;
+        }
+        status = sais_main_64(input, sizeof(uint8_t), sa, length, 256, NULL, 0, ctx);
+        if (status == BWT_STATUS_OK) {
+            bwt_emit_64(input, length, sa, output, chain_index, stride);
+        }
+        ws_free(ctx, sa);
+    }
+    return status;
+}
+
+static inline uint32_t rank_pair_key(const uint32_t *rank, size_t length, size_t h,
+                                     uint32_t idx, int use_rank0) {
+    if (use_rank0) {
+        return rank[idx];
+    }
+    /* Past the end sorts first; real ranks shift up by one. */
+    return (idx + h < length) ? rank[idx + h] + 1 : 0;
+}
+
+/*
+  32-bit radix sort of suffix indices by (rank[i], rank[i + h]). Keys are
+  read through the rank array instead of being stored beside each index,
+  which keeps the workspace at four uint32_t arrays.
+*/
+static bwt_status_t radix_sort_sa32(uint32_t **data, uint32_t **tmp, size_t length,
+                                    const uint32_t *rank, size_t h, size_t max_rank) {
+    int nthreads = (length > 1024) ? omp_get_max_threads() : 1;
+    size_t *hist = (size_t *)malloc((size_t)nthreads * RADIX_BUCKETS * sizeof(size_t));
+    if (!hist) {
+        return BWT_STATUS_ALLOCATION_FAILURE;
+    }
+
+    const int passes = radix_passes(max_rank + 1);
+
+    for (int use_rank0 = 0; use_rank0 < 2; ++use_rank0) {
+        for (int pass = 0; pass < passes; ++pass) {
+            const int shift = pass * RADIX_BITS;
+            int skip = 0;
+            const uint32_t *src = *data;
+            uint32_t *dst = *tmp;
+
+#pragma omp parallel num_threads(nthreads)
+            {
+                int tid = omp_get_thread_num();
+                int team = omp_get_num_threads();
+                size_t lo = length * (size_t)tid / (size_t)team;
+                size_t hi = length * (size_t)(tid + 1) / (size_t)team;
+                size_t *local = hist + (size_t)tid * RADIX_BUCKETS;
+
+                memset(local, 0, RADIX_BUCKETS * sizeof(size_t));
+                for (size_t i = lo; i < hi; ++i) {
+                    uint32_t key = rank_pair_key(rank, length, h, src[i], use_rank0);
+                    local[(key >> shift) & (RADIX_BUCKETS - 1)]++;
+                }
+
+#pragma omp barrier
+#pragma omp single
+                {
+                    size_t sum = 0;
+                    for (unsigned d = 0; d < RADIX_BUCKETS; ++d) {
+                        size_t digit_total = 0;
+                        for (int t = 0; t < team; ++t) {
+                            size_t c = hist[(size_t)t * RADIX_BUCKETS + d];
+                            hist[(size_t)t * RADIX_BUCKETS + d] = sum;
+                            sum += c;
+                            digit_total += c;
+                        }
+                        if (digit_total == length) {
+                            skip = 1;
+                        }
+                    }
+                }
+
+                if (!skip) {
+                    for (size_t i = lo; i < hi; ++i) {
+                        uint32_t key = rank_pair_key(rank, length, h, src[i], use_rank0);
+                        dst[local[(key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+                    }
+                }
+            }
+
+            if (!skip) {
+                *tmp = *data;
+                *data = dst;
+            }
+        }
+    }
+
+    free(hist);
+    return BWT_STATUS_OK;
+}
+
+/*
+  Dense ranks of the sorted (rank[i], rank[i + h]) pairs, written into
+  new_rank by position. The old ranks stay read-only, so chunks never race
+  on their neighbours. Returns the highest rank assigned.
+*/
+static size_t renumber_ranks32(const uint32_t *sa, size_t length, const uint32_t *rank,
+                               size_t h, uint32_t *new_rank) {
+    int nthreads = (length > 1024) ? omp_get_max_threads() : 1;
+    size_t *chunk_base = (size_t *)calloc((size_t)nthreads + 1, sizeof(size_t));
+    size_t max_rank = 0;
+    if (!chunk_base) {
+        nthreads = 1; /* fall back to a single sequential chunk */
     }
 
-    suffix_t *suffixes = (suffix_t *)malloc(length * sizeof(suffix_t));
-    size_t *index_to_pos = (size_t *)malloc(length * sizeof(size_t));
-    if (!suffixes || !index_to_pos) {
-        free(suffixes);
-        free(index_to_pos);
+#pragma omp parallel num_threads(nthreads)
+    {
+        int tid = omp_get_thread_num();
+        int team = omp_get_num_threads();
+        size_t lo = length * (size_t)tid / (size_t)team;
+        size_t hi = length * (size_t)(tid + 1) / (size_t)team;
+
+#define PAIR_DIFFERS(i) ((i) == 0 || \
+        rank_pair_key(rank, length, h, sa[i], 1) != rank_pair_key(rank, length, h, sa[(i) - 1], 1) || \
+        rank_pair_key(rank, length, h, sa[i], 0) != rank_pair_key(rank, length, h, sa[(i) - 1], 0))
+
+        size_t changes = 0;
+        if (team > 1) {
+            for (size_t i = lo; i < hi; ++i) {
+                changes += PAIR_DIFFERS(i);
+            }
+            chunk_base[tid + 1] = changes;
+        }
+
+#pragma omp barrier
+#pragma omp single
+        {
+            if (team > 1) {
+                for (int t = 0; t < team; ++t) {
+                    chunk_base[t + 1] += chunk_base[t];
+                }
+            }
+        }
+
+        size_t rank_so_far = (team > 1) ? chunk_base[tid] : 0;
+        for (size_t i = lo; i < hi; ++i) {
+            rank_so_far += PAIR_DIFFERS(i);
+            new_rank[sa[i]] = (uint32_t)(rank_so_far - 1);
+        }
+        if (hi == length && length > 0) {
+            max_rank = rank_so_far - 1;
+        }
+#undef PAIR_DIFFERS
+    }
+
+    free(chunk_base);
+    return max_rank;
+}
+
+// Prefix doubling with the compact 32-bit SoA workspace (16 bytes per input byte).
+static bwt_status_t bwt_forward_prefix_doubling_32(const uint8_t *input, size_t length, uint8_t *output,
+                                                   size_t *chain_index, size_t stride, bwt_context_t *ctx) {
+    uint32_t *sa = (uint32_t *)ws_alloc(ctx, length * sizeof(uint32_t));
+    uint32_t *scratch = (uint32_t *)ws_alloc(ctx, length * sizeof(uint32_t));
+    uint32_t *rank = (uint32_t *)ws_alloc(ctx, length * sizeof(uint32_t));
+    uint32_t *new_rank = (uint32_t *)ws_alloc(ctx, length * sizeof(uint32_t));
+    if (!sa || !scratch || !rank || !new_rank) {
+        ws_free(ctx, sa);
+        ws_free(ctx, scratch);
+        ws_free(ctx, rank);
+        ws_free(ctx, new_rank);
+        return BWT_STATUS_ALLOCATION_FAILURE;
+    }
+
+#pragma omp parallel for schedule(static) if (length > 1024)
+    for (size_t i = 0; i < length; ++i) {
+        sa[i] = (uint32_t)i;
+        rank[i] = input[i];
+    }
+
+    bwt_status_t status = BWT_STATUS_OK;
+    size_t max_rank = 255;
+    for (size_t h = 1; h < length; h <<= 1) {
+        ctx->doubling_rounds++;
+        status = radix_sort_sa32(&sa, &scratch, length, rank, h, max_rank);
+        if (status != BWT_STATUS_OK) {
+            break;
+        }
+
+        max_rank = renumber_ranks32(sa, length, rank, h, new_rank);
+        uint32_t *swap = rank;
+        rank = new_rank;
+        new_rank = swap;
+
+        if (max_rank == length - 1) {
+            break; /* Early exit: all ranks are unique. */
+        }
+    }
+
+    if (status == BWT_STATUS_OK) {
+        bwt_emit_32(input, length, sa, output, chain_index, stride);
+    }
+
+    ws_free(ctx, sa);
+    ws_free(ctx, scratch);
+    ws_free(ctx, rank);
+    ws_free(ctx, new_rank);
+    return status;
+}
+
+// Forward BWT using prefix doubling over (rank0, rank1) pairs (wide layout).
+static bwt_status_t bwt_forward_prefix_doubling(const uint8_t *input, size_t length, uint8_t *output,
+                                                size_t *chain_index, size_t stride, bwt_context_t *ctx) {
+    suffix_t *suffixes = (suffix_t *)ws_alloc(ctx, length * sizeof(suffix_t));
+    suffix_t *scratch = (suffix_t *)ws_alloc(ctx, length * sizeof(suffix_t));
+    size_t *index_to_pos = (size_t *)ws_alloc(ctx, length * sizeof(size_t));
+    if (!suffixes || !scratch || !index_to_pos) {
+        ws_free(ctx, suffixes);
+        ws_free(ctx, scratch);
+        ws_free(ctx, index_to_pos);
         return BWT_STATUS_ALLOCATION_FAILURE;
     }
 
@@ -63,27 +511,13 @@ static bwt_status_t bwt_forward_core(const uint8_t *input, size_t length,
         suffixes[i].rank1 = (i + 1 < length) ? input[i + 1] : -1;
     }
 
-    qsort(suffixes, length, sizeof(suffix_t), suffix_compare);
+    bwt_status_t status = radix_sort_suffixes(&suffixes, &scratch, length, 255, 255);
+    ctx->doubling_rounds++;
 
-    for (size_t k = 4; k < (length << 1); k <<= 1) {
-        int current_rank = 0;
-        int prev_rank0 = suffixes[0].rank0;
-        int prev_rank1 = suffixes[0].rank1;
-        suffixes[0].rank0 = current_rank;
-        index_to_pos[suffixes[0].index] = 0;
+    for (size_t k = 4; status == BWT_STATUS_OK && k < (length << 1); k <<= 1) {
+        size_t max_rank = renumber_ranks(suffixes, length, index_to_pos);
 
-        for (size_t i = 1; i < length; ++i) {
-            if (suffixes[i].rank0 == prev_rank0 && suffixes[i].rank1 == prev_rank1) {
-                suffixes[i].rank0 = current_rank;
-            } else {
-                prev_rank0 = suffixes[i].rank0;
-                prev_rank1 = suffixes[i].rank1;
-                suffixes[i].rank0 = ++current_rank;
-            }
-            index_to_pos[suffixes[i].index] = i;
-        }
-
-        if (current_rank == (int)length - 1) {
+        if (max_rank == length - 1) {
             break; /* Early exit: all ranks are unique. */
         }
 
@@ -93,47 +527,304 @@ static bwt_status_t bwt_forward_core(const uint8_t *input, size_t length,
             suffixes[i].rank1 = (next_index < length) ? suffixes[index_to_pos[next_index]].rank0 : -1;
         }
 
-        qsort(suffixes, length, sizeof(suffix_t), suffix_compare);
+        status = radix_sort_suffixes(&suffixes, &scratch, length, max_rank, max_rank);
+        ctx->doubling_rounds++;
+    }
+    ws_free(ctx, scratch);
+    if (status != BWT_STATUS_OK) {
+        ws_free(ctx, suffixes);
+        ws_free(ctx, index_to_pos);
+        return status;
     }
 
-    size_t primary = 0;
+    /* index_to_pos is no longer needed; reuse it as the suffix array. */
     for (size_t i = 0; i < length; ++i) {
-        size_t idx = suffixes[i].index;
-        output[i] = input[(idx == 0) ? (length - 1) : (idx - 1)];
-        if (idx == 0) {
-            primary = i;
+        index_to_pos[i] = suffixes[i].index;
+    }
+    ws_free(ctx, suffixes);
+
+    bwt_emit_64(input, length, index_to_pos, output, chain_index, stride);
+    ws_free(ctx, index_to_pos);
+    return BWT_STATUS_OK;
+}
+
+// Distance between chain starts: a power of two so chain k starts at k * stride.
+static size_t bwt_chain_stride(size_t length, size_t chains) {
+    if (chains == 0) {
+        chains = 1;
+    }
+    size_t target = (length + chains - 1) / chains;
+    size_t stride = 1;
+    while (stride < target) {
+        stride <<= 1;
+    }
+    return stride;
+}
+
+size_t bwt_chain_count(size_t length, size_t chains) {
+    if (length == 0) {
+        return 1;
+    }
+    size_t stride = bwt_chain_stride(length, chains);
+    return (length + stride - 1) / stride;
+}
+
+// Perform forward BWT on a binary input buffer.
+// input/output are binary buffers of 'length' bytes and may be the same
+// buffer. chain_index receives bwt_chain_count(length, chains) rows;
+// chain_index[0] is the primary index.
+// Workspace comes from ctx, or from a temporary context when ctx is NULL.
+static bwt_status_t bwt_forward_core(const uint8_t *input, size_t length, uint8_t *output,
+                                     size_t *chain_index, size_t chains,
+                                     const bwt_config_t *cfg, bwt_context_t *ctx) {
+    if (length == 0) {
+        if (chain_index) {
+            chain_index[0] = 0;
         }
+        return BWT_STATUS_OK;
+    }
+    if (cfg->engine != BWT_ENGINE_SAIS && cfg->engine != BWT_ENGINE_PREFIX_DOUBLING) {
+        return BWT_STATUS_INVALID_ARGUMENT;
     }
 
-    free(suffixes);
-    free(index_to_pos);
+    bwt_context_t local_ctx;
+    if (!ctx) {
+        bwt_context_init(&local_ctx);
+        ctx = &local_ctx;
+    }
+    ws_begin(ctx, bwt_forward_workspace_bytes(cfg, length) + BWT_WS_SLACK);
+
+    /* The calling thread's default team size is what every region below uses. */
+    int saved_threads = omp_get_max_threads();
+    omp_set_num_threads(bwt_team_size(cfg));
+    bwt_status_t status;
+    size_t stride = bwt_chain_stride(length, chains);
+    if (cfg->engine == BWT_ENGINE_SAIS) {
+        status = bwt_forward_sais(input, length, output, chain_index, stride, ctx);
+    } else if (bwt_fits_32(length)) {
+        status = bwt_forward_prefix_doubling_32(input, length, output, chain_index, stride, ctx);
+    } else {
+        status = bwt_forward_prefix_doubling(input, length, output, chain_index, stride, ctx);
+    }
+    omp_set_num_threads(saved_threads);
 
-    if (primary_index) {
-        *primary_index = primary;
+    if (ctx == &local_ctx) {
+        bwt_context_free(&local_ctx);
     }
-    
-    return BWT_STATUS_OK;
+    return status;
 }
 
+/*
+  Inverse layouts, from fastest to smallest. Each row needs its BWT symbol
+  and its LF successor:
+    packed   one word per row, LF << 8 | symbol (4 bytes up to 2^24 rows, else 8)
+    lf32     a 32-bit LF per row; the symbol is read from the BWT itself
+    sampled  no per-row table: LF is recomputed from symbol counts sampled
+             every 'interval' rows plus a scan of the BWT to the nearest sample
+  bwt_config_t.inverse_memory picks the fastest layout that fits.
+*/
+typedef enum {
+    BWT_INVERSE_PACKED,
+    BWT_INVERSE_LF32,
+    BWT_INVERSE_SAMPLED
+} bwt_inverse_layout_t;
+
+#define BWT_SAMPLE_MIN_SHIFT 8  /* 1 KiB of counts per 256 rows: 4 bytes/row */
+#define BWT_SAMPLE_MAX_SHIFT 16 /* 1/64 byte/row, scans up to 32 KiB per step */
+
+typedef struct {
+    bwt_inverse_layout_t layout;
+    unsigned shift;   /* sampled: log2 of the sample interval */
+    size_t bytes;     /* table bytes, excluding the chain start rows */
+} bwt_inverse_plan_t;
+
+static size_t bwt_sample_bytes(size_t length, unsigned shift) {
+    return ((length >> shift) + 1) * 256 * sizeof(uint32_t);
+}
+
+static bwt_inverse_plan_t bwt_inverse_plan(size_t length, size_t budget) {
+    bwt_inverse_plan_t plan = { BWT_INVERSE_PACKED, 0, 0 };
+    int narrow = length <= ((size_t)1 << 24);
+    plan.bytes = length * (narrow ? sizeof(uint32_t) : sizeof(uint64_t));
+    if (budget == 0 || plan.bytes <= budget || !bwt_fits_32(length)) {
+        return plan;
+    }
+    if (!narrow && length * sizeof(uint32_t) <= budget) {
+        plan.layout = BWT_INVERSE_LF32;
+        plan.bytes = length * sizeof(uint32_t);
+        return plan;
+    }
+    plan.layout = BWT_INVERSE_SAMPLED;
+    plan.shift = BWT_SAMPLE_MIN_SHIFT;
+    while (plan.shift < BWT_SAMPLE_MAX_SHIFT && bwt_sample_bytes(length, plan.shift) > budget) {
+        plan.shift++;
+    }
+    plan.bytes = bwt_sample_bytes(length, plan.shift);
+    return plan;
+}
+
+/*
+  Occurrence counts for the sampled layout: counts[k][c] is the number of
+  c in rows [0, k << shift), with the primary row left out and the
+  implicit last symbol counted once up front, as the packed build does.
+*/
+typedef struct {
+    const uint8_t *bwt;
+    size_t length;
+    size_t primary_index;
+    unsigned shift;
+    const uint32_t (*counts)[256];
+    const size_t *totals;
+} bwt_rank_t;
+
+static inline size_t bwt_count_byte(const uint8_t *data, size_t length, uint8_t c) {
+    size_t n = 0;
+    for (size_t i = 0; i < length; ++i) {
+        n += data[i] == c;
+    }
+    return n;
+}
+
+static inline size_t bwt_rank_lf(const bwt_rank_t *rank, size_t row) {
+    if (row == rank->primary_index) {
+        return 0;
+    }
+    uint8_t c = rank->bwt[row];
+    size_t interval = (size_t)1 << rank->shift;
+    size_t k = row >> rank->shift;
+    size_t begin = k << rank->shift;
+    size_t occ;
+    if (row - begin <= interval / 2 || begin + interval > rank->length) {
+        occ = rank->counts[k][c] + bwt_count_byte(rank->bwt + begin, row - begin, c);
+        if (rank->primary_index >= begin && rank->primary_index < row && rank->bwt[rank->primary_index] == c) {
+            occ--;
+        }
+    } else {
+        size_t end = begin + interval;
+        occ = rank->counts[k + 1][c] - bwt_count_byte(rank->bwt + row, end - row, c);
+        if (rank->primary_index > row && rank->primary_index < end && rank->bwt[rank->primary_index] == c) {
+            occ++;
+        }
+    }
+    return rank->totals[c] + occ;
+}
+
+/*
+  LF walk: STEP(table, row, out) stores the symbol of 'row' in out and
+  moves row to its LF successor. Chains are walked in groups of
+  BWT_INTERLEAVE so their cache misses overlap, and groups are spread
+  across threads.
+*/
+#define BWT_INTERLEAVE 8
+
+#define BWT_STEP_PACKED(table, r, out) do {                                                   \
+        uint64_t w_ = (table)[r];                                                             \
+        (out) = (uint8_t)w_;                                                                  \
+        (r) = (size_t)(w_ >> 8);                                                              \
+    } while (0)
+#define BWT_STEP_LF32(table, r, out) do {                                                     \
+        (out) = (table)->bwt[r];                                                              \
+        (r) = (table)->lf[r];                                                                 \
+    } while (0)
+#define BWT_STEP_SAMPLED(table, r, out) do {                                                  \
+        (out) = (table)->bwt[r];                                                              \
+        (r) = bwt_rank_lf((table), (r));                                                      \
+    } while (0)
+
+typedef struct {
+    const uint8_t *bwt;
+    const uint32_t *lf;
+} bwt_lf32_t;
+
+#define BWT_DEFINE_LF_WALK(TABLE, SUFFIX, STEP)                                               \
+static void bwt_lf_walk_##SUFFIX(TABLE table, size_t length, uint8_t *output,                 \
+                                 const size_t *start_row, size_t chains, size_t stride) {     \
+    size_t groups = (chains + BWT_INTERLEAVE - 1) / BWT_INTERLEAVE;                           \
+    _Pragma("omp parallel for schedule(dynamic, 1) if (groups > 1)")                          \
+    for (size_t g = 0; g < groups; ++g) {                                                     \
+        size_t first = g * BWT_INTERLEAVE;                                                    \
+        size_t count = (chains - first < BWT_INTERLEAVE) ? chains - first : BWT_INTERLEAVE;   \
+        size_t row[BWT_INTERLEAVE];                                                           \
+        size_t pos[BWT_INTERLEAVE];                                                           \
+        size_t left[BWT_INTERLEAVE];                                                          \
+        size_t common = stride;                                                               \
+        for (size_t c = 0; c < count; ++c) {                                                  \
+            size_t begin = (first + c) * stride;                                              \
+            size_t end = (begin + stride < length) ? begin + stride : length;                 \
+            row[c] = start_row[first + c];                                                    \
+            pos[c] = end;                                                                     \
+            left[c] = end - begin;                                                            \
+            if (left[c] < common) {                                                           \
+                common = left[c];                                                             \
+            }                                                                                 \
+        }                                                                                     \
+        for (size_t step = 0; step < common; ++step) {                                        \
+            for (size_t c = 0; c < count; ++c) {                                              \
+                STEP(table, row[c], output[--pos[c]]);                                        \
+            }                                                                                 \
+        }                                                                                     \
+        for (size_t c = 0; c < count; ++c) {                                                  \
+            for (size_t step = common; step < left[c]; ++step) {                              \
+                STEP(table, row[c], output[--pos[c]]);                                        \
+            }                                                                                 \
+        }                                                                                     \
+    }                                                                                         \
+}
+
+BWT_DEFINE_LF_WALK(const uint32_t *, 32, BWT_STEP_PACKED)
+BWT_DEFINE_LF_WALK(const uint64_t *, 64, BWT_STEP_PACKED)
+BWT_DEFINE_LF_WALK(const bwt_lf32_t *, lf32, BWT_STEP_LF32)
+BWT_DEFINE_LF_WALK(const bwt_rank_t *, sampled, BWT_STEP_SAMPLED)
+
 // Perform inverse BWT on a binary input buffer.
-// Reconstructs original binary data into output using LF-mapping.
+// Reconstructs original binary data into output using LF-mapping, walking
+// one independent chain per recorded chain index. budget caps the table
+// bytes (0: no cap) and selects the layout, see bwt_inverse_plan().
+// threads sizes the team (0: the caller's OpenMP default).
 static bwt_status_t bwt_inverse_core(const uint8_t *input, size_t length,
-                                     size_t primary_index, uint8_t *output,
-                                     int requested_threads) {
+                                     const size_t *chain_index, size_t chains,
+                                     uint8_t *output, size_t budget, int threads, bwt_context_t *ctx) {
     if (length == 0) {
         return BWT_STATUS_OK;
     }
-    if (primary_index >= length) {
+    size_t stride = bwt_chain_stride(length, chains);
+    if (bwt_chain_count(length, chains) != chains && chains != 1) {
         return BWT_STATUS_INVALID_ARGUMENT;
     }
-
-    size_t *lf = (size_t *)malloc(length * sizeof(size_t));
-    if (!lf) {
+    if (chains == 1) {
+        stride = length;
+    }
+    for (size_t c = 0; c < chains; ++c) {
+        if (chain_index[c] >= length) {
+            return BWT_STATUS_INVALID_ARGUMENT;
+        }
+    }
+    size_t primary_index = chain_index[0];
+
+    bwt_inverse_plan_t plan = bwt_inverse_plan(length, budget);
+    int narrow = length <= ((size_t)1 << 24);
+    bwt_context_t local_ctx;
+    if (!ctx) {
+        bwt_context_init(&local_ctx);
+        ctx = &local_ctx;
+    }
+    ws_begin(ctx, plan.bytes + chains * sizeof(size_t) + BWT_WS_SLACK);
+    void *table = ws_alloc(ctx, plan.bytes);
+    size_t *start_row = (size_t *)ws_alloc(ctx, chains * sizeof(size_t));
+    if (!table || !start_row) {
+        ws_free(ctx, table);
+        ws_free(ctx, start_row);
+        if (ctx == &local_ctx) {
+            bwt_context_free(&local_ctx);
+        }
         return BWT_STATUS_ALLOCATION_FAILURE;
     }
 
+    int saved_threads = omp_get_max_threads();
+    if (threads > 0) {
+        omp_set_num_threads(threads);
+    }
     size_t counts[256] = {0};
-    (void)requested_threads;
 
 #pragma omp parallel
     {
@@ -157,21 +848,80 @@ static bwt_status_t bwt_inverse_core(const uint8_t *input, size_t length,
         sum += counts[c];
     }
 
+    /*
+      The forward transform sorts suffixes with an implicit terminator, so the
+      row holding the empty suffix is not stored: it would come first and end
+      with the last input byte, which sits at primary_index in its place.
+      Count that occurrence first and skip the primary row itself.
+    */
+    uint8_t last = input[primary_index];
     size_t occ[256] = {0};
-    for (size_t i = 0; i < length; ++i) {
-        uint8_t ch = input[i];
-        lf[i] = totals[ch] + occ[ch];
-        occ[ch]++;
+    occ[last] = 1;
+    if (plan.layout == BWT_INVERSE_SAMPLED) {
+        uint32_t (*samples)[256] = (uint32_t (*)[256])table;
+        size_t mask = ((size_t)1 << plan.shift) - 1;
+        for (size_t i = 0; i < length; ++i) {
+            if ((i & mask) == 0) {
+                for (int c = 0; c < 256; ++c) {
+                    samples[i >> plan.shift][c] = (uint32_t)occ[c];
+                }
+            }
+            if (i != primary_index) {
+                occ[input[i]]++;
+            }
+        }
+        if ((length & mask) == 0) {
+            for (int c = 0; c < 256; ++c) {
+                samples[length >> plan.shift][c] = (uint32_t)occ[c];
+            }
+        }
+    } else {
+        for (size_t i = 0; i < length; ++i) {
+            uint8_t ch = input[i];
+            size_t lf = (i == primary_index) ? 0 : totals[ch] + occ[ch]++;
+            if (plan.layout == BWT_INVERSE_LF32) {
+                ((uint32_t *)table)[i] = (uint32_t)lf;
+            } else if (narrow) {
+                ((uint32_t *)table)[i] = (uint32_t)(lf << 8) | ch;
+            } else {
+                ((uint64_t *)table)[i] = ((uint64_t)lf << 8) | ch;
+            }
+        }
     }
 
-    size_t idx = primary_index;
-    for (size_t i = length; i-- > 0;) {
-        uint8_t ch = input[idx];
-        output[i] = ch;
-        idx = lf[idx];
+    /*
+      Chain c rebuilds [c * stride, (c + 1) * stride) backwards starting at
+      the row of suffix (c + 1) * stride. The last chain starts at the
+      empty-suffix row, whose symbol is 'last' and whose successor is the
+      row of suffix length - 1.
+    */
+    output[length - 1] = last;
+    for (size_t c = 0; c + 1 < chains; ++c) {
+        start_row[c] = chain_index[c + 1];
+    }
+    start_row[chains - 1] = totals[last];
+
+    /* Walk everything except output[length - 1]; drop the last chain if that was all it had. */
+    size_t walk_chains = (chains > 1 && (chains - 1) * stride == length - 1) ? chains - 1 : chains;
+    if (plan.layout == BWT_INVERSE_SAMPLED) {
+        bwt_rank_t rank = { input, length, primary_index, plan.shift,
+                            (const uint32_t (*)[256])table, totals };
+        bwt_lf_walk_sampled(&rank, length - 1, output, start_row, walk_chains, stride);
+    } else if (plan.layout == BWT_INVERSE_LF32) {
+        bwt_lf32_t lf32 = { input, (const uint32_t *)table };
+        bwt_lf_walk_lf32(&lf32, length - 1, output, start_row, walk_chains, stride);
+    } else if (narrow) {
+        bwt_lf_walk_32((const uint32_t *)table, length - 1, output, start_row, walk_chains, stride);
+    } else {
+        bwt_lf_walk_64((const uint64_t *)table, length - 1, output, start_row, walk_chains, stride);
     }
+    omp_set_num_threads(saved_threads);
 
-    free(lf);
+    ws_free(ctx, table);
+    ws_free(ctx, start_row);
+    if (ctx == &local_ctx) {
+        bwt_context_free(&local_ctx);
+    }
     return BWT_STATUS_OK;
 }
 
@@ -181,6 +931,48 @@ void bwt_config_init(bwt_config_t *cfg) {
     }
     cfg->block_size = 1u << 20;
     cfg->threads = 0;
+    cfg->engine = BWT_ENGINE_SAIS;
+    cfg->chains = 16;
+    cfg->in_flight = 1;
+    cfg->inverse_memory = 0;
+}
+
+/*
+  Peak working-set bytes bwt_forward_ex() needs for one block of 'length'
+  bytes, on top of the caller's input and output buffers.
+*/
+size_t bwt_forward_workspace_bytes(const bwt_config_t *cfg, size_t length) {
+    bwt_config_t local_cfg;
+    if (!cfg) {
+        bwt_config_init(&local_cfg);
+        cfg = &local_cfg;
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    size_t radix_hist = (size_t)bwt_team_size(cfg) * RADIX_BUCKETS * sizeof(size_t);
+    if (cfg->engine == BWT_ENGINE_PREFIX_DOUBLING) {
+        if (bwt_fits_32(length)) {
+            return 4 * length * sizeof(uint32_t) + radix_hist;
+        }
+        return 2 * length * sizeof(suffix_t) + length * sizeof(size_t) + radix_hist;
+    }
+
+    /* Suffix array, plus type bitmaps of all recursion levels (< n/4 bytes). */
+    size_t index_size = bwt_fits_32(length) ? sizeof(uint32_t) : sizeof(size_t);
+    return length * index_size + (length + 3) / 4 + 2 * 256 * index_size;
+}
+
+/*
+  Table bytes bwt_inverse_chains() needs for one block of 'length' bytes
+  under cfg->inverse_memory, on top of the input and output buffers.
+*/
+size_t bwt_inverse_workspace_bytes(const bwt_config_t *cfg, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    return bwt_inverse_plan(length, cfg ? cfg->inverse_memory : 0).bytes;
 }
 
 // Simple forward BWT API for binary buffers (validates args).
@@ -189,7 +981,58 @@ bwt_status_t bwt_forward(const uint8_t *input, size_t length,
     if (!input || !output || !primary_index) {
         return BWT_STATUS_INVALID_ARGUMENT;
     }
-    return bwt_forward_core(input, length, output, primary_index, 0);
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+    return bwt_forward_core(input, length, output, primary_index, 1, &cfg, NULL);
+}
+
+// Forward BWT with an explicit configuration (engine selection).
+bwt_status_t bwt_forward_ex(const bwt_config_t *cfg, const uint8_t *input, size_t length,
+                            uint8_t *output, size_t *primary_index) {
+    if (!input || !output || !primary_index) {
+        return BWT_STATUS_INVALID_ARGUMENT;
+    }
+    bwt_config_t local_cfg;
+    if (!cfg) {
+        bwt_config_init(&local_cfg);
+        cfg = &local_cfg;
+    }
+    return bwt_forward_core(input, length, output, primary_index, 1, cfg, NULL);
+}
+
+// Forward BWT that also records the rows of bwt_chain_count(length, chains)
+// evenly spaced suffixes, so the inverse can walk that many chains at once.
+bwt_status_t bwt_forward_chains(const bwt_config_t *cfg, const uint8_t *input, size_t length,
+                                uint8_t *output, size_t *chain_index, size_t chains) {
+    return bwt_forward_chains_ctx(NULL, cfg, input, length, output, chain_index, chains);
+}
+
+// bwt_forward_chains drawing its workspace from ctx (NULL: a temporary one).
+bwt_status_t bwt_forward_chains_ctx(bwt_context_t *ctx, const bwt_config_t *cfg, const uint8_t *input,
+                                    size_t length, uint8_t *output, size_t *chain_index, size_t chains) {
+    if (!input || !output || !chain_index || chains == 0) {
+        return BWT_STATUS_INVALID_ARGUMENT;
+    }
+    bwt_config_t local_cfg;
+    if (!cfg) {
+        bwt_config_init(&local_cfg);
+        cfg = &local_cfg;
+    }
+    return bwt_forward_core(input, length, output, chain_index, chains, cfg, ctx);
+}
+
+// Forward BWT overwriting data with its transform.
+bwt_status_t bwt_forward_in_place(bwt_context_t *ctx, const bwt_config_t *cfg, uint8_t *data,
+                                  size_t length, size_t *primary_index) {
+    if (!data || !primary_index) {
+        return BWT_STATUS_INVALID_ARGUMENT;
+    }
+    bwt_config_t local_cfg;
+    if (!cfg) {
+        bwt_config_init(&local_cfg);
+        cfg = &local_cfg;
+    }
+    return bwt_forward_core(data, length, data, primary_index, 1, cfg, ctx);
 }
 
 // Simple inverse BWT API for binary buffers (validates args).
@@ -198,7 +1041,23 @@ bwt_status_t bwt_inverse(const uint8_t *input, size_t length,
     if (!input || !output) {
         return BWT_STATUS_INVALID_ARGUMENT;
     }
-    return bwt_inverse_core(input, length, primary_index, output, 0);
+    return bwt_inverse_core(input, length, &primary_index, 1, output, 0, 0, NULL);
+}
+
+// Inverse BWT walking the chains recorded by bwt_forward_chains.
+bwt_status_t bwt_inverse_chains(const bwt_config_t *cfg, const uint8_t *input, size_t length,
+                                const size_t *chain_index, size_t chains, uint8_t *output) {
+    return bwt_inverse_chains_ctx(NULL, cfg, input, length, chain_index, chains, output);
+}
+
+// bwt_inverse_chains drawing its workspace from ctx (NULL: a temporary one).
+bwt_status_t bwt_inverse_chains_ctx(bwt_context_t *ctx, const bwt_config_t *cfg, const uint8_t *input,
+                                    size_t length, const size_t *chain_index, size_t chains, uint8_t *output) {
+    if (!input || !output || !chain_index || chains == 0) {
+        return BWT_STATUS_INVALID_ARGUMENT;
+    }
+    return bwt_inverse_core(input, length, chain_index, chains, output, cfg ? cfg->inverse_memory : 0,
+                            cfg ? cfg->threads : 0, ctx);
 }
 
 // Allocate output buffer and run forward BWT (binary).
@@ -211,7 +1070,9 @@ bwt_status_t bwt_forward_alloc(const uint8_t *input, size_t length,
     if (!buffer) {
         return BWT_STATUS_ALLOCATION_FAILURE;
     }
-    bwt_status_t status = bwt_forward_core(input, length, buffer, primary_index, 0);
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+    bwt_status_t status = bwt_forward_core(input, length, buffer, primary_index, 1, &cfg, NULL);
     if (status != BWT_STATUS_OK) {
         free(buffer);
         return status;
@@ -230,7 +1091,7 @@ bwt_status_t bwt_inverse_alloc(const uint8_t *input, size_t length,
     if (!buffer) {
         return BWT_STATUS_ALLOCATION_FAILURE;
     }
-    bwt_status_t status = bwt_inverse_core(input, length, primary_index, buffer, 0);
+    bwt_status_t status = bwt_inverse_core(input, length, &primary_index, 1, buffer, 0, 0, NULL);
     if (status != BWT_STATUS_OK) {
         free(buffer);
         return status;
@@ -239,58 +1100,294 @@ bwt_status_t bwt_inverse_alloc(const uint8_t *input, size_t length,
     return BWT_STATUS_OK;
 }
 
-// Stream forward BWT over binary data.
-// reader must read raw bytes and return number of bytes read.
-// writer writes binary output and receives the primary index.
-bwt_status_t bwt_forward_stream(const bwt_config_t *cfg,
-                                bwt_read_cb reader, void *reader_ctx,
-                                bwt_write_cb writer, void *writer_ctx) {
-    if (!reader || !writer) {
-        return BWT_STATUS_INVALID_ARGUMENT;
+/*
+  Pipelined streaming engine. Blocks cycle through a ring of in_flight
+  slots: a reader thread fills slot i, the calling thread transforms it
+  (keeping its OpenMP team for the transform itself) and a writer thread
+  drains it. Each stage owns one counter that only it advances, so the
+  stages hand slots over with acquire/release atomics and no locks. With
+  in_flight <= 1 the three stages simply run in turn on the caller.
+*/
+typedef struct {
+    uint8_t *input;
+    uint8_t *output;
+    size_t capacity;
+    size_t length;
+    size_t primary_index;
+} stream_slot_t;
+
+// Stage adapters: fill returns 1 with a block, 0 at the end, or a negative bwt_status_t
+typedef int (*stream_fill_fn)(void *io, stream_slot_t *slot);
+typedef bwt_status_t (*stream_drain_fn)(void *io, const stream_slot_t *slot);
+
+typedef struct {
+    const bwt_config_t *cfg;
+    int inverse;
+    stream_fill_fn fill;
+    stream_drain_fn drain;
+    void *io;
+    stream_slot_t *slots;
+    size_t count;
+    _Atomic size_t filled;      /* advanced by the reader */
+    _Atomic size_t transformed; /* advanced by the transform */
+    _Atomic size_t drained;     /* advanced by the writer */
+    _Atomic int reader_done;
+    _Atomic int transform_done;
+    _Atomic int failed;         /* any stage stopped early; the others wind down */
+    bwt_status_t read_status;
+    bwt_status_t write_status;
+} stream_ring_t;
+
+// Grows a slot's buffers; the old contents are not kept. Forward slots
+// transform in place and have no separate output buffer.
+static int stream_slot_reserve(stream_slot_t *slot, size_t capacity, int separate_output) {
+    if (capacity <= slot->capacity) {
+        return 1;
+    }
+    if (slot->output == slot->input) {
+        slot->output = NULL;
+    }
+    uint8_t *input = (uint8_t *)realloc(slot->input, capacity);
+    if (input) {
+        slot->input = input;
     }
+    uint8_t *output = !input ? NULL : separate_output ? (uint8_t *)realloc(slot->output, capacity) : input;
+    if (output) {
+        slot->output = output;
+        slot->capacity = capacity;
+    }
+    return output != NULL;
+}
 
-    bwt_config_t local_cfg;
-    if (!cfg) {
-        bwt_config_init(&local_cfg);
-        cfg = &local_cfg;
+// Waits for another stage: spin briefly, then yield, then sleep so a stage stalled on I/O costs no CPU.
+static void stream_backoff(unsigned *spins) {
+    if (++*spins < 64) {
+        return;
     }
+    if (*spins < 128) {
+        sched_yield();
+        return;
+    }
+    struct timespec pause = { 0, 50000 };
+    nanosleep(&pause, NULL);
+}
 
-    size_t block_size = clamp_block_size(cfg->block_size);
+static bwt_status_t stream_transform(stream_ring_t *ring, stream_slot_t *slot, bwt_context_t *ctx) {
+    if (ring->inverse) {
+        return bwt_inverse_core(slot->input, slot->length, &slot->primary_index, 1, slot->output,
+                                ring->cfg->inverse_memory, ring->cfg->threads, ctx);
+    }
+    return bwt_forward_core(slot->input, slot->length, slot->input, &slot->primary_index, 1, ring->cfg, ctx);
+}
 
-    uint8_t *input_block = (uint8_t *)malloc(block_size);
-    uint8_t *output_block = (uint8_t *)malloc(block_size);
-    if (!input_block || !output_block) {
-        free(input_block);
-        free(output_block);
-        return BWT_STATUS_ALLOCATION_FAILURE;
+static void *stream_reader(void *arg) {
+    stream_ring_t *ring = (stream_ring_t *)arg;
+    for (size_t i = 0;; ++i) {
+        unsigned spins = 0;
+        while (i - atomic_load_explicit(&ring->drained, memory_order_acquire) >= ring->count &&
+               !atomic_load_explicit(&ring->failed, memory_order_acquire)) {
+            stream_backoff(&spins);
+        }
+        if (atomic_load_explicit(&ring->failed, memory_order_acquire)) {
+            break;
+        }
+        int got = ring->fill(ring->io, &ring->slots[i % ring->count]);
+        if (got <= 0) {
+            if (got < 0) {
+                ring->read_status = (bwt_status_t)got;
+                atomic_store_explicit(&ring->failed, 1, memory_order_release);
+            }
+            break;
+        }
+        atomic_store_explicit(&ring->filled, i + 1, memory_order_release);
     }
+    atomic_store_explicit(&ring->reader_done, 1, memory_order_release);
+    return NULL;
+}
 
-    bwt_status_t status = BWT_STATUS_OK;
+static void *stream_writer(void *arg) {
+    stream_ring_t *ring = (stream_ring_t *)arg;
+    for (size_t i = 0;; ++i) {
+        unsigned spins = 0;
+        while (i >= atomic_load_explicit(&ring->transformed, memory_order_acquire)) {
+            if (atomic_load_explicit(&ring->failed, memory_order_acquire) ||
+                (atomic_load_explicit(&ring->transform_done, memory_order_acquire) &&
+                 i >= atomic_load_explicit(&ring->transformed, memory_order_acquire))) {
+                return NULL;
+            }
+            stream_backoff(&spins);
+        }
+        bwt_status_t status = ring->drain(ring->io, &ring->slots[i % ring->count]);
+        if (status != BWT_STATUS_OK) {
+            ring->write_status = status;
+            atomic_store_explicit(&ring->failed, 1, memory_order_release);
+            return NULL;
+        }
+        atomic_store_explicit(&ring->drained, i + 1, memory_order_release);
+    }
+}
+
+// Runs the transform stage on the calling thread between the reader and writer threads.
+static bwt_status_t stream_run_pipelined(stream_ring_t *ring, bwt_context_t *ctx) {
+    pthread_t reader;
+    pthread_t writer;
+    if (pthread_create(&reader, NULL, stream_reader, ring) != 0) {
+        return BWT_STATUS_INTERNAL_ERROR;
+    }
+    if (pthread_create(&writer, NULL, stream_writer, ring) != 0) {
+        atomic_store_explicit(&ring->failed, 1, memory_order_release);
+        pthread_join(reader, NULL);
+        return BWT_STATUS_INTERNAL_ERROR;
+    }
 
-    while (1) {
-        size_t got = reader(reader_ctx, input_block, block_size);
-        if (got == 0) {
+    bwt_status_t status = BWT_STATUS_OK;
+    for (size_t i = 0;; ++i) {
+        unsigned spins = 0;
+        int ready = 1;
+        while (i >= atomic_load_explicit(&ring->filled, memory_order_acquire)) {
+            if (atomic_load_explicit(&ring->failed, memory_order_acquire) ||
+                (atomic_load_explicit(&ring->reader_done, memory_order_acquire) &&
+                 i >= atomic_load_explicit(&ring->filled, memory_order_acquire))) {
+                ready = 0;
+                break;
+            }
+            stream_backoff(&spins);
+        }
+        if (!ready) {
             break;
         }
-        size_t primary_index = 0;
-        status = bwt_forward_core(input_block, got, output_block, &primary_index, cfg->threads);
+        status = stream_transform(ring, &ring->slots[i % ring->count], ctx);
         if (status != BWT_STATUS_OK) {
+            atomic_store_explicit(&ring->failed, 1, memory_order_release);
             break;
         }
-        if (writer(writer_ctx, output_block, got, primary_index) != 0) {
-            status = BWT_STATUS_INTERNAL_ERROR;
-            break;
+        atomic_store_explicit(&ring->transformed, i + 1, memory_order_release);
+    }
+    atomic_store_explicit(&ring->transform_done, 1, memory_order_release);
+
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    if (ring->read_status != BWT_STATUS_OK) {
+        return ring->read_status;
+    }
+    return status != BWT_STATUS_OK ? status : ring->write_status;
+}
+
+static bwt_status_t stream_run(const bwt_config_t *cfg, int inverse, stream_fill_fn fill,
+                               stream_drain_fn drain, void *io) {
+    stream_ring_t ring;
+    memset(&ring, 0, sizeof(ring));
+    ring.cfg = cfg;
+    ring.inverse = inverse;
+    ring.fill = fill;
+    ring.drain = drain;
+    ring.io = io;
+    ring.count = cfg->in_flight > 1 ? cfg->in_flight : 1;
+    ring.slots = (stream_slot_t *)calloc(ring.count, sizeof(stream_slot_t));
+    if (!ring.slots) {
+        return BWT_STATUS_ALLOCATION_FAILURE;
+    }
+
+    bwt_context_t ctx; /* one workspace for every block */
+    bwt_context_init(&ctx);
+    bwt_status_t status = BWT_STATUS_OK;
+    if (ring.count > 1) {
+        status = stream_run_pipelined(&ring, &ctx);
+    } else {
+        stream_slot_t *slot = &ring.slots[0];
+        int got;
+        while (status == BWT_STATUS_OK && (got = fill(io, slot)) != 0) {
+            status = got < 0 ? (bwt_status_t)got : stream_transform(&ring, slot, &ctx);
+            if (status == BWT_STATUS_OK) {
+                status = drain(io, slot);
+            }
         }
     }
 
-    free(input_block);
-    free(output_block);
+    bwt_context_free(&ctx);
+    for (size_t i = 0; i < ring.count; ++i) {
+        if (ring.slots[i].output != ring.slots[i].input) {
+            free(ring.slots[i].output);
+        }
+        free(ring.slots[i].input);
+    }
+    free(ring.slots);
     return status;
 }
 
+typedef struct {
+    size_t block_size;
+    bwt_read_cb reader;
+    bwt_read_block_cb block_reader;
+    bwt_write_cb writer;
+    void *reader_ctx;
+    void *writer_ctx;
+    FILE *in;
+    FILE *out;
+} stream_io_t;
+
+static int fill_from_reader(void *arg, stream_slot_t *slot) {
+    stream_io_t *io = (stream_io_t *)arg;
+    if (!stream_slot_reserve(slot, io->block_size, 0)) {
+        return BWT_STATUS_ALLOCATION_FAILURE;
+    }
+    slot->length = io->reader(io->reader_ctx, slot->input, io->block_size);
+    return slot->length > 0;
+}
+
+static int fill_from_block_reader(void *arg, stream_slot_t *slot) {
+    stream_io_t *io = (stream_io_t *)arg;
+    if (!stream_slot_reserve(slot, io->block_size, 1)) {
+        return BWT_STATUS_ALLOCATION_FAILURE;
+    }
+    slot->primary_index = 0;
+    slot->length = io->block_reader(io->reader_ctx, slot->input, slot->capacity, &slot->primary_index);
+    if (slot->length > slot->capacity && !stream_slot_reserve(slot, slot->length, 1)) {
+        return BWT_STATUS_ALLOCATION_FAILURE;
+    }
+    return slot->length > 0;
+}
+
+static bwt_status_t drain_to_writer(void *arg, const stream_slot_t *slot) {
+    stream_io_t *io = (stream_io_t *)arg;
+    return io->writer(io->writer_ctx, slot->output, slot->length, slot->primary_index) == 0
+               ? BWT_STATUS_OK
+               : BWT_STATUS_INTERNAL_ERROR;
+}
+
+static bwt_status_t drain_to_writer_inverse(void *arg, const stream_slot_t *slot) {
+    stream_io_t *io = (stream_io_t *)arg;
+    return io->writer(io->writer_ctx, slot->output, slot->length, 0) == 0 ? BWT_STATUS_OK
+                                                                          : BWT_STATUS_INTERNAL_ERROR;
+}
+
+// Stream forward BWT over binary data.
+// reader must read raw bytes and return number of bytes read.
+// writer writes binary output and receives the primary index.
+// With cfg->in_flight > 1, reader and writer run on their own threads,
+// concurrently with each other and the transform.
+bwt_status_t bwt_forward_stream(const bwt_config_t *cfg,
+                                bwt_read_cb reader, void *reader_ctx,
+                                bwt_write_cb writer, void *writer_ctx) {
+    if (!reader || !writer) {
+        return BWT_STATUS_INVALID_ARGUMENT;
+    }
+
+    bwt_config_t local_cfg;
+    if (!cfg) {
+        bwt_config_init(&local_cfg);
+        cfg = &local_cfg;
+    }
+
+    stream_io_t io = { clamp_block_size(cfg->block_size), reader, NULL, writer, reader_ctx, writer_ctx, NULL, NULL };
+    return stream_run(cfg, 0, fill_from_reader, drain_to_writer, &io);
+}
+
 // Stream inverse BWT over binary data.
 // reader must read raw bytes and supply primary_index for each block.
 // writer writes reconstructed binary data.
+// With cfg->in_flight > 1, reader and writer run on their own threads,
+// concurrently with each other and the transform.
 bwt_status_t bwt_inverse_stream(const bwt_config_t *cfg,
                                 bwt_read_block_cb reader, void *reader_ctx,
                                 bwt_write_cb writer, void *writer_ctx) {
@@ -304,53 +1401,53 @@ bwt_status_t bwt_inverse_stream(const bwt_config_t *cfg,
         cfg = &local_cfg;
     }
 
-    size_t capacity = clamp_block_size(cfg->block_size);
+    stream_io_t io = { clamp_block_size(cfg->block_size), NULL, reader, writer, reader_ctx, writer_ctx, NULL, NULL };
+    return stream_run(cfg, 1, fill_from_block_reader, drain_to_writer_inverse, &io);
+}
 
-    uint8_t *input_block = (uint8_t *)malloc(capacity);
-    uint8_t *output_block = (uint8_t *)malloc(capacity);
-    if (!input_block || !output_block) {
-        free(input_block);
-        free(output_block);
+static int fill_from_file(void *arg, stream_slot_t *slot) {
+    stream_io_t *io = (stream_io_t *)arg;
+    if (!stream_slot_reserve(slot, io->block_size, 0)) {
         return BWT_STATUS_ALLOCATION_FAILURE;
     }
+    slot->length = fread(slot->input, 1, io->block_size, io->in);
+    if (slot->length == 0) {
+        return feof(io->in) ? 0 : BWT_STATUS_INTERNAL_ERROR;
+    }
+    return 1;
+}
 
-    bwt_status_t status = BWT_STATUS_OK;
-
-    while (1) {
-        size_t primary_index = 0;
-        size_t got = reader(reader_ctx, input_block, capacity, &primary_index);
-        if (got == 0) {
-            break;
-        }
-        if (got > capacity) {
-            uint8_t *tmp_in = (uint8_t *)realloc(input_block, got);
-            if (!tmp_in) {
-                status = BWT_STATUS_ALLOCATION_FAILURE;
-                break;
-            }
-            input_block = tmp_in;
+static bwt_status_t drain_blocks_to_file(void *arg, const stream_slot_t *slot) {
+    stream_io_t *io = (stream_io_t *)arg;
+    uint64_t header[2] = { (uint64_t)slot->length, (uint64_t)slot->primary_index };
+    if (fwrite(header, sizeof(header), 1, io->out) != 1 ||
+        fwrite(slot->output, 1, slot->length, io->out) != slot->length) {
+        return BWT_STATUS_INTERNAL_ERROR;
+    }
+    return BWT_STATUS_OK;
+}
 
-            uint8_t *tmp_out = (uint8_t *)realloc(output_block, got);
-            if (!tmp_out) {
-                status = BWT_STATUS_ALLOCATION_FAILURE;
-                break;
-            }
-            output_block = tmp_out;
-            capacity = got;
-        }
-        status = bwt_inverse_core(input_block, got, primary_index, output_block, cfg->threads);
-        if (status != BWT_STATUS_OK) {
-            break;
-        }
-        if (writer(writer_ctx, output_block, got, 0) != 0) {
-            status = BWT_STATUS_INTERNAL_ERROR;
-            break;
-        }
+static int fill_blocks_from_file(void *arg, stream_slot_t *slot) {
+    stream_io_t *io = (stream_io_t *)arg;
+    uint64_t header[2];
+    size_t got = fread(header, sizeof(header[0]), 2, io->in);
+    if (got != 2) {
+        return got == 0 && feof(io->in) ? 0 : BWT_STATUS_INTERNAL_ERROR;
     }
+    uint64_t len64 = header[0];
+    uint64_t prim64 = header[1];
+    if (!stream_slot_reserve(slot, len64 > io->block_size ? (size_t)len64 : io->block_size, 1)) {
+        return BWT_STATUS_ALLOCATION_FAILURE;
+    }
+    slot->length = (size_t)len64;
+    slot->primary_index = (size_t)prim64;
+    return fread(slot->input, 1, slot->length, io->in) == slot->length ? 1 : BWT_STATUS_INTERNAL_ERROR;
+}
 
-    free(input_block);
-    free(output_block);
-    return status;
+static bwt_status_t drain_to_file(void *arg, const stream_slot_t *slot) {
+    stream_io_t *io = (stream_io_t *)arg;
+    return fwrite(slot->output, 1, slot->length, io->out) == slot->length ? BWT_STATUS_OK
+                                                                         : BWT_STATUS_INTERNAL_ERROR;
 }
 
 /* 
@@ -369,45 +1466,8 @@ bwt_status_t bwt_forward_file(const bwt_config_t *cfg, FILE *in, FILE *out) {
         cfg = &local_cfg;
     }
 
-    size_t block_size = clamp_block_size(cfg->block_size);
-
-    uint8_t *input_block = (uint8_t *)malloc(block_size);
-    uint8_t *output_block = (uint8_t *)malloc(block_size);
-    if (!input_block || !output_block) {
-        free(input_block);
-        free(output_block);
-        return BWT_STATUS_ALLOCATION_FAILURE;
-    }
-
-    bwt_status_t status = BWT_STATUS_OK;
-
-    while (1) {
-        size_t got = fread(input_block, 1, block_size, in);
-        if (got == 0) {
-            if (feof(in)) break;
-            status = BWT_STATUS_INTERNAL_ERROR;
-            break;
-        }
-
-        size_t primary_index = 0;
-        status = bwt_forward_core(input_block, got, output_block, &primary_index, cfg->threads);
-        if (status != BWT_STATUS_OK) {
-            break;
-        }
-
-        uint64_t len64 = (uint64_t)got;
-        uint64_t prim64 = (uint64_t)primary_index;
-        if (fwrite(&len64, sizeof(len64), 1, out) != 1 ||
-            fwrite(&prim64, sizeof(prim64), 1, out) != 1 ||
-            fwrite(output_block, 1, got, out) != got) {
-            status = BWT_STATUS_INTERNAL_ERROR;
-            break;
-        }
-    }
-
-    free(input_block);
-    free(output_block);
-    return status;
+    stream_io_t io = { clamp_block_size(cfg->block_size), NULL, NULL, NULL, NULL, NULL, in, out };
+    return stream_run(cfg, 0, fill_from_file, drain_blocks_to_file, &io);
 }
 
 /* 
@@ -426,62 +1486,6 @@ bwt_status_t bwt_inverse_file(const bwt_config_t *cfg, FILE *in, FILE *out) {
         cfg = &local_cfg;
     }
 
-    size_t capacity = clamp_block_size(cfg->block_size);
-
-    uint8_t *input_block = (uint8_t *)malloc(capacity);
-    uint8_t *output_block = (uint8_t *)malloc(capacity);
-    if (!input_block || !output_block) {
-        free(input_block);
-        free(output_block);
-        return BWT_STATUS_ALLOCATION_FAILURE;
-    }
-
-    bwt_status_t status = BWT_STATUS_OK;
-
-    while (1) {
-        uint64_t len64 = 0;
-        uint64_t prim64 = 0;
-        if (fread(&len64, sizeof(len64), 1, in) != 1) {
-            if (feof(in)) { status = BWT_STATUS_OK; break; }
-            status = BWT_STATUS_INTERNAL_ERROR;
-            break;
-        }
-        if (fread(&prim64, sizeof(prim64), 1, in) != 1) {
-            status = BWT_STATUS_INTERNAL_ERROR;
-            break;
-        }
-
-        size_t got = (size_t)len64;
-        size_t primary_index = (size_t)prim64;
-
-        if (got > capacity) {
-            uint8_t *tmp_in = (uint8_t *)realloc(input_block, got);
-            if (!tmp_in) { status = BWT_STATUS_ALLOCATION_FAILURE; break; }
-            input_block = tmp_in;
-
-            uint8_t *tmp_out = (uint8_t *)realloc(output_block, got);
-            if (!tmp_out) { status = BWT_STATUS_ALLOCATION_FAILURE; break; }
-            output_block = tmp_out;
-            capacity = got;
-        }
-
-        if (fread(input_block, 1, got, in) != got) {
-            status = BWT_STATUS_INTERNAL_ERROR;
-            break;
-        }
-
-        status = bwt_inverse_core(input_block, got, primary_index, output_block, cfg->threads);
-        if (status != BWT_STATUS_OK) {
-            break;
-        }
-
-        if (fwrite(output_block, 1, got, out) != got) {
-            status = BWT_STATUS_INTERNAL_ERROR;
-            break;
-        }
-    }
-
-    free(input_block);
-    free(output_block);
-    return status;
+    stream_io_t io = { clamp_block_size(cfg->block_size), NULL, NULL, NULL, NULL, NULL, in, out };
+    return stream_run(cfg, 1, fill_blocks_from_file, drain_to_file, &io);
 }
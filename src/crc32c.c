@@ -0,0 +1,97 @@
+#include "crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u // reflected Castagnoli polynomial
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zero bytes
+static uint32_t crc_table[8][256];
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t *data, size_t length);
+
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t *data, size_t length)
+{
+    while (length >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        word ^= crc;
+        crc = crc_table[7][word & 0xFF] ^ crc_table[6][(word >> 8) & 0xFF] ^
+              crc_table[5][(word >> 16) & 0xFF] ^ crc_table[4][(word >> 24) & 0xFF] ^
+              crc_table[3][(word >> 32) & 0xFF] ^ crc_table[2][(word >> 40) & 0xFF] ^
+              crc_table[1][(word >> 48) & 0xFF] ^ crc_table[0][word >> 56];
+        data += 8;
+        length -= 8;
+    }
+    while (length--)
+    {
+        crc = crc_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t length)
+{
+    uint64_t c = crc;
+    while (length >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        c = _mm_crc32_u64(c, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)c;
+    while (length--)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+static crc32c_fn crc32c_impl = crc32c_scalar;
+
+// Build the tables and pick the hardware instruction before any thread can hash
+__attribute__((constructor)) static void crc32c_init(void)
+{
+    for (uint32_t b = 0; b < 256; b++)
+    {
+        uint32_t crc = b;
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crc_table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++)
+    {
+        for (int k = 1; k < 8; k++)
+        {
+            crc_table[k][b] = crc_table[0][crc_table[k - 1][b] & 0xFF] ^ (crc_table[k - 1][b] >> 8);
+        }
+    }
+
+#ifdef CRC32C_HAVE_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c_impl = crc32c_sse42;
+    }
+#endif
+}
+
+uint32_t crc32c_update(uint32_t crc, const uint8_t *data, size_t length)
+{
+    if (!data || length == 0)
+    {
+        return crc;
+    }
+    return ~crc32c_impl(~crc, data, length);
+}
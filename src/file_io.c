@@ -0,0 +1,555 @@
+#define _GNU_SOURCE // copy_file_range
+#include "file_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#include <linux/io_uring.h>
+#define IO_HAVE_URING 1
+#endif
+#endif
+
+int io_map_fd(int fd, io_map_t *map)
+{
+    map->data = NULL;
+    map->size = 0;
+
+    struct stat statbuf;
+    if (fd < 0 || fstat(fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode) || statbuf.st_size <= 0 ||
+        (uint64_t)statbuf.st_size > SIZE_MAX)
+    {
+        return -1;
+    }
+
+    size_t size = (size_t)statbuf.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    // Read-ahead aggressively and let the kernel back the range with huge pages if it can
+    madvise(data, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(data, size, MADV_HUGEPAGE);
+#endif
+
+    map->data = (const uint8_t *)data;
+    map->size = size;
+    return 0;
+}
+
+void io_map_release(const io_map_t *map, size_t offset, size_t length)
+{
+    if (!map->data || length == 0)
+    {
+        return;
+    }
+
+    // madvise works on whole pages; keep the partial page at each end mapped
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = (offset + page - 1) / page * page;
+    size_t end = (offset + length) / page * page;
+    if (end > begin)
+    {
+        madvise((void *)(map->data + begin), end - begin, MADV_DONTNEED);
+    }
+}
+
+void io_unmap(io_map_t *map)
+{
+    if (map->data)
+    {
+        munmap((void *)map->data, map->size);
+    }
+    map->data = NULL;
+    map->size = 0;
+}
+
+int io_pwrite_all(int fd, const uint8_t *buffer, size_t length, uint64_t offset)
+{
+    while (length > 0)
+    {
+        ssize_t written = pwrite(fd, buffer, length, (off_t)offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        buffer += written;
+        length -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return 0;
+}
+
+int io_copy_file(int dst_fd, int src_fd)
+{
+    struct stat statbuf;
+    if (fstat(src_fd, &statbuf) != 0)
+    {
+        return -1;
+    }
+#ifdef FICLONE
+    if (ioctl(dst_fd, FICLONE, src_fd) == 0)
+    {
+        return 0;
+    }
+#endif
+
+    uint64_t length = (uint64_t)statbuf.st_size;
+    off_t in = 0;
+    off_t out = 0;
+    while (length > 0)
+    {
+        ssize_t copied = copy_file_range(src_fd, &in, dst_fd, &out, (size_t)length, 0);
+        if (copied < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (copied <= 0)
+        {
+            break; // not supported across these descriptors: finish with plain reads
+        }
+        length -= (uint64_t)copied;
+    }
+
+    uint8_t buffer[64 * 1024];
+    while (length > 0)
+    {
+        ssize_t got = pread(src_fd, buffer, length < sizeof(buffer) ? (size_t)length : sizeof(buffer), in);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0 || io_pwrite_all(dst_fd, buffer, (size_t)got, (uint64_t)out) != 0)
+        {
+            return -1;
+        }
+        in += got;
+        out += got;
+        length -= (uint64_t)got;
+    }
+    return 0;
+}
+
+// Reads until 'length' bytes arrived; 0 on an error or end of file before that
+static int pread_all(int fd, uint8_t *buffer, size_t length, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < length)
+    {
+        ssize_t got = pread(fd, buffer + done, length - done, (off_t)(offset + done));
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return 0; // error, or the file shrank
+        }
+        done += (size_t)got;
+    }
+    return 1;
+}
+
+int io_read_one(io_read_t *read)
+{
+    int fd = read->fd;
+    if (fd < 0 && (fd = open(read->path, O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        read->result = -1;
+        return -1;
+    }
+    read->result = pread_all(fd, read->buffer, read->length, read->offset);
+    if (fd != read->fd)
+    {
+        close(fd);
+    }
+    return read->result;
+}
+
+static void read_batch_sync(io_read_t *reads, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        io_read_one(&reads[i]);
+    }
+}
+
+// Most threads the pool backend starts, however deep the queue
+#define IO_MAX_THREADS 16
+
+typedef struct
+{
+    io_read_t *reads;
+    size_t count;
+    _Atomic size_t next;
+} io_pool_t;
+
+static void *pool_worker(void *arg)
+{
+    io_pool_t *pool = (io_pool_t *)arg;
+    size_t i;
+    while ((i = atomic_fetch_add_explicit(&pool->next, 1, memory_order_relaxed)) < pool->count)
+    {
+        io_read_one(&pool->reads[i]);
+    }
+    return NULL;
+}
+
+// The caller works through the reads alongside depth - 1 pool threads
+static void read_batch_threads(io_read_t *reads, size_t count, unsigned depth)
+{
+    io_pool_t pool;
+    pool.reads = reads;
+    pool.count = count;
+    atomic_init(&pool.next, 0);
+
+    size_t threads = depth < IO_MAX_THREADS ? depth : IO_MAX_THREADS;
+    threads = threads < count ? threads : count;
+    pthread_t workers[IO_MAX_THREADS];
+    size_t started = 0;
+    while (started + 1 < threads && pthread_create(&workers[started], NULL, pool_worker, &pool) == 0)
+    {
+        started++;
+    }
+    pool_worker(&pool);
+    for (size_t t = 0; t < started; t++)
+    {
+        pthread_join(workers[t], NULL);
+    }
+}
+
+#ifdef IO_HAVE_URING
+
+// A single-issuer io_uring driven through the raw system calls
+typedef struct
+{
+    int fd;
+    unsigned entries;
+    unsigned pending; // queued entries not yet handed to the kernel
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_len;
+    size_t cq_ring_len;
+    size_t sqes_len;
+} io_uring_t;
+
+static void uring_close(io_uring_t *ring)
+{
+    if (ring->sqes)
+    {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_len);
+    }
+    if (ring->sq_ring)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_len);
+    }
+    close(ring->fd);
+}
+
+static int uring_setup(io_uring_t *ring, unsigned depth)
+{
+    memset(ring, 0, sizeof(*ring));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+    if (ring->fd < 0)
+    {
+        return -1; // no io_uring in this kernel, or a sandbox forbids it
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sq = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                    IORING_OFF_SQ_RING);
+    void *cq = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                    IORING_OFF_CQ_RING);
+    void *sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    ring->sq_ring = sq == MAP_FAILED ? NULL : sq;
+    ring->cq_ring = cq == MAP_FAILED ? NULL : cq;
+    ring->sqes = sqes == MAP_FAILED ? NULL : (struct io_uring_sqe *)sqes;
+    if (!ring->sq_ring || !ring->cq_ring || !ring->sqes)
+    {
+        uring_close(ring);
+        return -1;
+    }
+
+    uint8_t *sq_base = (uint8_t *)ring->sq_ring;
+    uint8_t *cq_base = (uint8_t *)ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq_base + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq_base + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq_base + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq_base + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq_base + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq_base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq_base + params.cq_off.cqes);
+    return 0;
+}
+
+// Queues one entry; the caller never has more than 'entries' operations outstanding
+static struct io_uring_sqe *uring_push(io_uring_t *ring, uint8_t opcode, uint64_t user_data)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+    return sqe;
+}
+
+// Submits what is queued and waits for at least one completion
+static int uring_enter(io_uring_t *ring)
+{
+    for (;;)
+    {
+        int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted >= 0)
+        {
+            ring->pending -= (unsigned)submitted;
+            return 0;
+        }
+        if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+}
+
+// Per-read progress; user_data carries the read's index and whether the entry is its open
+typedef struct
+{
+    int fd;
+    size_t done;
+    int finished;
+} uring_read_t;
+
+#define URING_OPEN_TAG 1u
+// Largest length one read entry asks for
+#define URING_MAX_READ (1u << 30)
+
+static void uring_push_open(io_uring_t *ring, const io_read_t *read, size_t index)
+{
+    struct io_uring_sqe *sqe = uring_push(ring, IORING_OP_OPENAT, ((uint64_t)index << 1) | URING_OPEN_TAG);
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)read->path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+}
+
+static void uring_push_read(io_uring_t *ring, const io_read_t *read, const uring_read_t *state, size_t index)
+{
+    size_t left = read->length - state->done;
+    struct io_uring_sqe *sqe = uring_push(ring, IORING_OP_READ, (uint64_t)index << 1);
+    sqe->fd = state->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(read->buffer + state->done);
+    sqe->len = left < URING_MAX_READ ? (unsigned)left : URING_MAX_READ;
+    sqe->off = read->offset + state->done;
+}
+
+// Kernels that predate an opcode reject it with EINVAL; those steps then run inline
+static int uring_unsupported(int res)
+{
+    return res == -EINVAL || res == -EOPNOTSUPP;
+}
+
+/*
+  Keeps up to 'depth' files moving through open -> read -> close at once.
+  Each completion queues the read's next step, so a slow open or a read
+  that returns short only holds up its own file. Returns -1 without
+  touching any read when no ring can be set up.
+*/
+static int read_batch_uring(io_read_t *reads, size_t count, unsigned depth)
+{
+    uring_read_t *states = (uring_read_t *)malloc(count * sizeof(uring_read_t));
+    io_uring_t ring;
+    if (!states || uring_setup(&ring, depth) != 0)
+    {
+        free(states);
+        return -1;
+    }
+
+    size_t next = 0;
+    size_t finished = 0;
+    unsigned in_flight = 0;
+    while (finished < count)
+    {
+        while (in_flight < ring.entries && next < count)
+        {
+            io_read_t *read = &reads[next];
+            states[next].fd = read->fd;
+            states[next].done = 0;
+            states[next].finished = 0;
+            if (read->fd >= 0 && read->length == 0)
+            {
+                read->result = 1;
+                states[next].finished = 1;
+                finished++;
+                next++;
+                continue;
+            }
+            if (read->fd < 0)
+            {
+                uring_push_open(&ring, read, next);
+            }
+            else
+            {
+                uring_push_read(&ring, read, &states[next], next);
+            }
+            in_flight++;
+            next++;
+        }
+        if (in_flight == 0)
+        {
+            continue;
+        }
+        if (uring_enter(&ring) != 0)
+        {
+            break;
+        }
+
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            size_t index = (size_t)(cqe->user_data >> 1);
+            int res = cqe->res;
+            io_read_t *read = &reads[index];
+            uring_read_t *state = &states[index];
+            int result = 1;
+
+            if (cqe->user_data & URING_OPEN_TAG)
+            {
+                if (uring_unsupported(res))
+                {
+                    res = open(read->path, O_RDONLY | O_CLOEXEC);
+                    res = res < 0 ? -errno : res;
+                }
+                if (res < 0)
+                {
+                    result = -1;
+                }
+                else
+                {
+                    state->fd = res;
+                    if (read->length > 0)
+                    {
+                        uring_push_read(&ring, read, state, index);
+                        continue;
+                    }
+                }
+            }
+            else if (res > 0)
+            {
+                state->done += (size_t)res;
+                if (state->done < read->length)
+                {
+                    uring_push_read(&ring, read, state, index);
+                    continue;
+                }
+            }
+            else if (res == -EINTR || res == -EAGAIN)
+            {
+                uring_push_read(&ring, read, state, index);
+                continue;
+            }
+            else if (uring_unsupported(res))
+            {
+                result = pread_all(state->fd, read->buffer + state->done, read->length - state->done,
+                                   read->offset + state->done);
+            }
+            else
+            {
+                result = 0; // error, or the file shrank
+            }
+
+            read->result = result;
+            if (state->fd >= 0 && state->fd != read->fd)
+            {
+                close(state->fd);
+            }
+            state->finished = 1;
+            finished++;
+            in_flight--;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    uring_close(&ring);
+    if (finished < count)
+    {
+        // The ring failed midway: redo whatever had not completed on this thread
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i < next && states[i].finished)
+            {
+                continue;
+            }
+            if (i < next && states[i].fd >= 0 && states[i].fd != reads[i].fd)
+            {
+                close(states[i].fd);
+            }
+            io_read_one(&reads[i]);
+        }
+    }
+    free(states);
+    return 0;
+}
+
+#endif // IO_HAVE_URING
+
+io_backend_t io_read_batch(io_read_t *reads, size_t count, unsigned depth, io_backend_t backend)
+{
+    if (depth <= 1 || count <= 1)
+    {
+        backend = IO_BACKEND_SYNC;
+    }
+#ifdef IO_HAVE_URING
+    if ((backend == IO_BACKEND_AUTO || backend == IO_BACKEND_URING) && read_batch_uring(reads, count, depth) == 0)
+    {
+        return IO_BACKEND_URING;
+    }
+#endif
+    if (backend != IO_BACKEND_SYNC)
+    {
+        read_batch_threads(reads, count, depth);
+        return IO_BACKEND_THREADS;
+    }
+    read_batch_sync(reads, count);
+    return IO_BACKEND_SYNC;
+}
@@ -1,6 +1,9 @@
 #include "file_manager.h"
 #include "bwt.h"
-#include "rle.h"
+#include "crc32c.h"
+#include "file_io.h"
+#include "pipeline.h"
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,17 +12,141 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <omp.h>
 
 #define MAX_PATH 4096
 #define BUFFER_SIZE (1024 * 1024) // 1 MiB
 
-// Structure for file metadata in the .w container
+/*
+  .w container layout (version 3):
+    header:  [magic "WBWT"][version u32]
+    records: [type] followed by the record body
+      FM_RECORD_ENTRY:     [filename_len][filename], the file's block records
+                           and a terminating [block_len = 0]
+      FM_RECORD_SOLID:     [member_count], member_count x [filename_len][filename][size],
+                           then one block record holding the members back to back
+      FM_RECORD_LINK:      [filename_len][filename][target_len][target]: a file with
+                           the same bytes as the earlier entry 'target'
+      FM_RECORD_DIRECTORY: [entry_count], then per entry
+                           [kind][filename_len][filename][entry_offset][original_size]
+                           [solid_offset][block_count]
+                           and block_count x [record_offset][block_len][checksum]
+                           kind is the type of the record holding the entry; a
+                           solid member starts solid_offset bytes into its block.
+                           A link's entry repeats its target's, so it is
+                           extracted from the target's blocks
+    footer:  [directory_offset][directory_checksum][magic "WBWT"][version u32]
+  A block record is
+    [block_len][stages][chain_count][chain_index x chain_count][checksum][compressed_len][payload]
+  Integers are uint64_t unless noted; checksums are CRC-32C. Entries carry
+  no size up front, so they can be written while the input is still being
+  read (pipes, stdin); the central directory at the end is what lets a
+  reader seek straight to one entry. Each block runs through its own
+  pipeline (stages is a pipeline_stage_t mask), so blocks can be processed
+  in parallel on both sides and entries may use different pipelines.
+  chain_index[0] is the BWT primary index; the other rows let the inverse
+  walk several LF chains of the block at once. chain_count is 0 without BWT.
+*/
+#define FM_MAGIC "WBWT"
+#define FM_MAGIC_SIZE 4
+#define FM_FORMAT_VERSION 3u
+#define FM_RECORD_ENTRY 1u
+#define FM_RECORD_DIRECTORY 2u
+#define FM_RECORD_SOLID 3u
+#define FM_RECORD_LINK 4u
+#define FM_FOOTER_SIZE (2 * sizeof(uint64_t) + FM_MAGIC_SIZE + sizeof(uint32_t))
+
+// A regular file queued for compression
+typedef struct
+{
+    char *path;    // path the file is opened with
+    char *name;    // entry name stored in the archive
+    uint64_t size; // size seen by the scan
+    int fd;        // open while blocks of a large file are in flight, else -1
+    io_map_t map;  // large files are read in place through a mapping
+    int missing;   // a solid member that vanished before it could be read
+    size_t id;       // position in scan order, which references use to name an original
+    size_t original; // id of an earlier file with the same bytes, or SIZE_MAX
+    size_t entry;    // directory index once written, or SIZE_MAX
+    uint32_t hash;   // CRC-32C of the contents when 'hashed'
+    int hashed;
+} file_source_t;
+
+// One block in flight, with buffers that grow as needed and are reused across batches
+typedef struct
+{
+    const uint8_t *data;   // block bytes: 'input', or a view into a mapped file
+    uint8_t *input;        // read buffer for unmapped sources
+    uint8_t *encoded;
+    uint8_t *scratch;
+    size_t input_cap;
+    size_t encoded_cap;
+    size_t scratch_cap;
+    size_t input_len;
+    size_t encoded_len;
+    uint32_t checksum; // CRC-32C of the block's original bytes
+    pipeline_block_t block;
+    pipeline_status_t status;
+    uint32_t stages;        // picked when the block was sized, or FM_STAGES_SCAN for the worker to scan
+    file_source_t *source;  // file the block is read from; NULL when 'input' is already filled
+    uint64_t source_offset;
+    size_t member_count;    // > 0: a solid block of source[0..member_count) back to back
+    int first_in_entry;     // the writer starts the entry record with this block
+    int last_in_entry;      // and terminates it after this block
+    int missing;            // the file vanished before it could be read
+    pipeline_stats_t stats; // filled when the call collects fm_stats_t
+    double load_seconds;
+} block_job_t;
+
+// A file packed into a solid block
+typedef struct
+{
+    char *name;
+    uint64_t size;
+} solid_member_t;
+
+// One compressed block waiting to be decoded and written
 typedef struct
 {
-    uint64_t filename_len;
-    uint64_t data_len;
-    uint64_t primary_index;
-} file_header_t;
+    const uint8_t *payload; // view into the mapped archive, or 'compressed'
+    uint8_t *compressed;
+    uint8_t *scratch;
+    uint8_t *output;
+    size_t compressed_cap;
+    size_t scratch_cap;
+    size_t output_cap;
+    uint64_t compressed_len;
+    uint64_t block_len;
+    uint64_t checksum;
+    pipeline_block_t block;
+    int fd;            // destination of this block
+    uint64_t offset;   // position of the block within its file
+    int sequential;    // fd is a pipe: append instead of writing at 'offset'
+    int last_in_entry; // the writer closes 'fd' after this block
+    uint64_t slice_offset; // part of the decoded block that is written
+    uint64_t slice_len;
+    solid_member_t *members; // solid block: files written back to back from the output
+    size_t member_count;
+    size_t member_cap;
+    char *link_name;   // link record: a copy of the earlier entry link_target, nothing to decode
+    char *link_target;
+    fm_status_t status;
+    size_t inverse_memory;  // bwt_config_t.inverse_memory for this block, 0 for no cap
+    pipeline_stats_t stats; // filled when the call collects fm_stats_t
+} decode_job_t;
+
+// Workspace an fm_context_t keeps between calls
+struct fm_context
+{
+    block_job_t *jobs;
+    int job_count;
+    decode_job_t *decode_jobs;
+    int decode_count;
+    bwt_context_t *workers; // BWT workspace per worker thread
+    int worker_count;
+    io_read_t *reads; // file reads of the batch being loaded
+    int read_count;
+};
 
 fm_path_type_t fm_get_path_type(const char *path)
 {
@@ -31,401 +158,2799 @@ fm_path_type_t fm_get_path_type(const char *path)
     return S_ISDIR(statbuf.st_mode) ? FM_TYPE_DIRECTORY : FM_TYPE_FILE;
 }
 
-// Compresses an individual file using BWT
-static fm_status_t compress_single_file(FILE *in, FILE *out, const char *filename)
+// Files smaller than this are packed into shared solid blocks by default
+#define FM_SOLID_MAX_FILE (64 * 1024)
+// Upper bound on the files packed into one solid block
+#define FM_SOLID_MAX_MEMBERS 4096
+// File reads in flight while a batch loads
+#define FM_IO_DEPTH 32
+
+void fm_config_init(fm_config_t *cfg)
+{
+    if (!cfg)
+    {
+        return;
+    }
+    bwt_config_init(&cfg->bwt);
+    cfg->stages = PIPELINE_DEFAULT_STAGES;
+    cfg->adaptive = 1;
+    cfg->solid_max_file = FM_SOLID_MAX_FILE;
+    cfg->dedup = 1;
+    cfg->io_depth = FM_IO_DEPTH;
+    cfg->io_backend = IO_BACKEND_AUTO;
+    cfg->memory_limit = 0;
+    cfg->context = NULL;
+    cfg->stats = NULL;
+}
+
+// Number of blocks transformed concurrently
+static int block_parallelism(const fm_config_t *cfg)
+{
+    return cfg->bwt.threads > 0 ? cfg->bwt.threads : omp_get_max_threads();
+}
+
+/*
+  Splits a batch's threads between blocks and the transform inside each
+  block: up to 'threads' blocks run at once and each gets an equal share
+  of what is left, so the two levels together never exceed 'threads'.
+  Both levels size their teams with num_threads, never process-wide
+  settings, so concurrent calls do not disturb each other. A share inside
+  a batch of several blocks needs nested regions, which only the process
+  can enable (OMP_MAX_ACTIVE_LEVELS); without them the blocks run on one
+  thread each and the whole team goes to a batch's lone block.
+*/
+typedef struct
+{
+    int workers; // blocks transformed at once
+    int inner;   // bwt_config_t.threads for each of them
+} thread_split_t;
+
+static thread_split_t split_threads(int threads, int blocks)
+{
+    thread_split_t split;
+    split.workers = blocks < threads ? (blocks > 0 ? blocks : 1) : threads;
+    split.inner = threads / split.workers;
+    if (split.workers > 1 && omp_get_max_active_levels() < 2)
+    {
+        split.inner = 1;
+    }
+    return split;
+}
+
+static size_t block_size_of(const fm_config_t *cfg)
+{
+    return cfg->bwt.block_size ? cfg->bwt.block_size : BUFFER_SIZE;
+}
+
+// Share of the memory limit (1/8) left for everything besides blocks:
+// file lists, the directory, stdio buffers and the process itself
+#define FM_MEMORY_RESERVE_SHIFT 3
+// Blocks are not shrunk below this to fit a memory limit
+#define FM_MIN_BLOCK_SIZE (64 * 1024)
+// Blocks the scan keeps from the BWT grow to at most this many times block_size
+#define FM_MAX_BLOCK_GROWTH 8
+// block_job_t.stages when the worker scans the block itself
+#define FM_STAGES_SCAN UINT32_MAX
+
+uint64_t fm_cgroup_memory_max(const char *proc_cgroup, const char *root)
+{
+    char cgroup[MAX_PATH] = "";
+    char line[MAX_PATH];
+    FILE *file = fopen(proc_cgroup ? proc_cgroup : "/proc/self/cgroup", "r");
+    if (!file)
+    {
+        return FM_MEMORY_UNLIMITED;
+    }
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, "0::", 3) == 0)
+        {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(cgroup, sizeof(cgroup), "%s", line + 3);
+            break;
+        }
+    }
+    fclose(file);
+
+    uint64_t limit = FM_MEMORY_UNLIMITED;
+    while (cgroup[0] == '/')
+    {
+        char path[2 * MAX_PATH + 16];
+        snprintf(path, sizeof(path), "%s%s/memory.max", root ? root : "/sys/fs/cgroup", cgroup);
+        file = fopen(path, "r");
+        if (file)
+        {
+            unsigned long long value;
+            if (fscanf(file, "%llu", &value) == 1 && value < limit) // "max" does not parse
+            {
+                limit = value;
+            }
+            fclose(file);
+        }
+        *strrchr(cgroup, '/') = '\0';
+    }
+    return limit;
+}
+
+// What blocks may use: the limit less the reserve
+static uint64_t usable_memory(uint64_t limit)
+{
+    return limit == FM_MEMORY_UNLIMITED ? limit : limit - (limit >> FM_MEMORY_RESERVE_SHIFT);
+}
+
+// Memory one block in flight costs the compressor: its input, encoded and
+// scratch buffers and the BWT workspace of the worker encoding it
+static uint64_t compress_block_bytes(const fm_config_t *cfg, size_t block_size)
+{
+    uint64_t bytes = (uint64_t)block_size + 2 * (uint64_t)pipeline_max_encoded_size(cfg->stages, block_size);
+    if (cfg->stages & PIPELINE_STAGE_BWT)
+    {
+        bytes += bwt_forward_workspace_bytes(&cfg->bwt, block_size);
+    }
+    return bytes;
+}
+
+// Copies cfg into 'planned' with memory_limit resolved (0: the cgroup's)
+static const fm_config_t *plan_memory(const fm_config_t *cfg, fm_config_t *planned)
+{
+    *planned = *cfg;
+    planned->memory_limit = cfg->memory_limit ? cfg->memory_limit : fm_cgroup_memory_max(NULL, NULL);
+    return planned;
+}
+
+/*
+  Size of a block the scan keeps from the BWT: as large as fits in the
+  memory of one block_size block with it, which the BWT workspace
+  dominates, so skipping the transform also means fewer, larger records
+*/
+static size_t wide_block_size(const fm_config_t *cfg, size_t block_size)
+{
+    fm_config_t plain = *cfg;
+    plain.stages &= ~(uint32_t)PIPELINE_STAGE_BWT;
+    uint64_t budget = compress_block_bytes(cfg, block_size);
+    size_t size = block_size;
+    while (size <= SIZE_MAX / 2 && size < block_size * (size_t)FM_MAX_BLOCK_GROWTH &&
+           compress_block_bytes(&plain, size * 2) <= budget)
+    {
+        size *= 2;
+    }
+    return size;
+}
+
+/*
+  Fits a compress call into its memory limit: as many workers as the
+  limit holds blocks, and if not even one block fits, smaller blocks
+  down to FM_MIN_BLOCK_SIZE. One worker always runs.
+*/
+static const fm_config_t *plan_compress_memory(const fm_config_t *cfg, fm_config_t *planned)
+{
+    plan_memory(cfg, planned);
+    uint64_t usable = usable_memory(planned->memory_limit);
+    if (usable == FM_MEMORY_UNLIMITED)
+    {
+        return planned;
+    }
+    size_t block_size = block_size_of(cfg);
+    while (block_size > FM_MIN_BLOCK_SIZE && compress_block_bytes(cfg, block_size) > usable)
+    {
+        block_size /= 2;
+    }
+    uint64_t fit = usable / compress_block_bytes(cfg, block_size);
+    int threads = block_parallelism(cfg);
+    planned->bwt.block_size = block_size;
+    planned->bwt.threads = fit >= (uint64_t)threads ? threads : fit > 0 ? (int)fit : 1;
+    return planned;
+}
+
+// Grows a scratch buffer to at least 'needed' bytes
+static int ensure_capacity(uint8_t **buffer, size_t *capacity, size_t needed)
+{
+    if (needed <= *capacity)
+    {
+        return 1;
+    }
+    uint8_t *tmp = (uint8_t *)realloc(*buffer, needed);
+    if (!tmp)
+    {
+        return 0;
+    }
+    *buffer = tmp;
+    *capacity = needed;
+    return 1;
+}
+
+// Grows one of the context's job arrays to 'count' zeroed slots, keeping existing buffers
+static void *context_grow(void *array, int *count, int needed, size_t size)
+{
+    if (array && *count >= needed)
+    {
+        return array;
+    }
+    uint8_t *grown = (uint8_t *)realloc(array, (size_t)needed * size);
+    if (!grown)
+    {
+        return NULL;
+    }
+    memset(grown + (size_t)*count * size, 0, (size_t)(needed - *count) * size);
+    *count = needed;
+    return grown;
+}
+
+static block_job_t *context_block_jobs(fm_context_t *ctx, int count)
+{
+    block_job_t *jobs = (block_job_t *)context_grow(ctx->jobs, &ctx->job_count, count, sizeof(block_job_t));
+    if (jobs)
+    {
+        ctx->jobs = jobs;
+    }
+    return jobs;
+}
+
+static decode_job_t *context_decode_jobs(fm_context_t *ctx, int count)
+{
+    decode_job_t *jobs =
+        (decode_job_t *)context_grow(ctx->decode_jobs, &ctx->decode_count, count, sizeof(decode_job_t));
+    if (jobs)
+    {
+        ctx->decode_jobs = jobs;
+    }
+    return jobs;
+}
+
+// One BWT workspace per thread of a team of 'count'; a zeroed context is an initialized one
+static bwt_context_t *context_workers(fm_context_t *ctx, int count)
+{
+    bwt_context_t *workers =
+        (bwt_context_t *)context_grow(ctx->workers, &ctx->worker_count, count, sizeof(bwt_context_t));
+    if (workers)
+    {
+        ctx->workers = workers;
+    }
+    return workers;
+}
+
+static io_read_t *context_reads(fm_context_t *ctx, int count)
+{
+    io_read_t *reads = (io_read_t *)context_grow(ctx->reads, &ctx->read_count, count, sizeof(io_read_t));
+    if (reads)
+    {
+        ctx->reads = reads;
+    }
+    return reads;
+}
+
+static void context_free(fm_context_t *ctx)
+{
+    for (int i = 0; i < ctx->job_count; i++)
+    {
+        free(ctx->jobs[i].input);
+        free(ctx->jobs[i].encoded);
+        free(ctx->jobs[i].scratch);
+    }
+    for (int i = 0; i < ctx->decode_count; i++)
+    {
+        decode_job_t *job = &ctx->decode_jobs[i];
+        for (size_t m = 0; m < job->member_count; m++)
+        {
+            free(job->members[m].name);
+        }
+        free(job->members);
+        free(job->link_name);
+        free(job->link_target);
+        free(job->compressed);
+        free(job->scratch);
+        free(job->output);
+    }
+    for (int i = 0; i < ctx->worker_count; i++)
+    {
+        bwt_context_free(&ctx->workers[i]);
+    }
+    free(ctx->jobs);
+    free(ctx->decode_jobs);
+    free(ctx->workers);
+    free(ctx->reads);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+// The caller's context from cfg, or 'local' emptied for a single call
+static fm_context_t *acquire_context(const fm_config_t *cfg, fm_context_t *local)
+{
+    memset(local, 0, sizeof(*local));
+    return cfg->context ? cfg->context : local;
+}
+
+static void release_context(fm_context_t *ctx, fm_context_t *local)
+{
+    if (ctx == local)
+    {
+        context_free(local);
+    }
+}
+
+fm_context_t *fm_context_create(void)
+{
+    return (fm_context_t *)calloc(1, sizeof(fm_context_t));
+}
+
+void fm_context_destroy(fm_context_t *ctx)
+{
+    if (ctx)
+    {
+        context_free(ctx);
+        free(ctx);
+    }
+}
+
+size_t fm_context_high_water(const fm_context_t *ctx)
+{
+    if (!ctx)
+    {
+        return 0;
+    }
+    size_t bytes = (size_t)ctx->job_count * sizeof(block_job_t) + (size_t)ctx->decode_count * sizeof(decode_job_t);
+    for (int i = 0; i < ctx->job_count; i++)
+    {
+        bytes += ctx->jobs[i].input_cap + ctx->jobs[i].encoded_cap + ctx->jobs[i].scratch_cap;
+    }
+    for (int i = 0; i < ctx->decode_count; i++)
+    {
+        const decode_job_t *job = &ctx->decode_jobs[i];
+        bytes += job->compressed_cap + job->scratch_cap + job->output_cap + job->member_cap * sizeof(solid_member_t);
+    }
+    for (int i = 0; i < ctx->worker_count; i++)
+    {
+        bytes += bwt_context_high_water(&ctx->workers[i]);
+    }
+    return bytes + (size_t)ctx->read_count * sizeof(io_read_t);
+}
+
+const char *fm_stats_stage_name(int stage)
+{
+    static const char *const names[FM_STATS_STAGES] = {"bwt", "mtf", "rle", "huffman"};
+    return (stage >= 0 && stage < FM_STATS_STAGES) ? names[stage] : "unknown";
+}
+
+// Starts a call's figures. Until stats_finish, 'seconds' and 'allocated_bytes'
+// hold the start time and the context's size so it can take the differences.
+static void stats_begin(fm_stats_t *stats, const fm_config_t *cfg, const fm_context_t *ctx)
+{
+    if (stats)
+    {
+        memset(stats, 0, sizeof(*stats));
+        stats->threads = block_parallelism(cfg);
+        stats->memory_limit = cfg->memory_limit;
+        stats->seconds = omp_get_wtime();
+        stats->allocated_bytes = fm_context_high_water(ctx);
+    }
+}
+
+static void stats_finish(fm_stats_t *stats, const fm_context_t *ctx, uint64_t archive_bytes)
+{
+    if (stats)
+    {
+        stats->seconds = omp_get_wtime() - stats->seconds;
+        stats->allocated_bytes = fm_context_high_water(ctx) - stats->allocated_bytes;
+        stats->archive_bytes = archive_bytes;
+    }
+}
+
+// Adds the figures of one block that went through the pipeline
+static void stats_add_block(fm_stats_t *stats, const pipeline_stats_t *block, uint32_t stages, uint64_t original_bytes)
+{
+    for (int i = 0; i < FM_STATS_STAGES; i++)
+    {
+        stats->stage_seconds[i] += block->seconds[i];
+        stats->stage_bytes_in[i] += block->bytes_in[i];
+        stats->stage_bytes_out[i] += block->bytes_out[i];
+    }
+    stats->allocations += block->allocations;
+    stats->doubling_rounds += block->doubling_rounds;
+    stats->original_bytes += original_bytes;
+    stats->blocks++;
+    stats->stored_blocks += stages == 0;
+    stats->rle_blocks += (stages & PIPELINE_STAGE_RLE) && !(stages & PIPELINE_STAGE_BWT);
+}
+
+// Reads 'length' bytes at 'offset' of source; a negative result means the file could not be opened
+static int read_source(const file_source_t *source, uint8_t *buffer, size_t length, uint64_t offset)
+{
+    io_read_t read = {source->path, source->fd, buffer, length, offset, 0};
+    return io_read_one(&read);
+}
+
+/*
+  Like read_source, but reads up to 'length' bytes and sets *got to the
+  bytes read: fewer when the file shrank since the scan, whose size the
+  caller then takes as the file's.
+*/
+static int read_available(const file_source_t *source, uint8_t *buffer, size_t length, uint64_t offset, size_t *got)
+{
+    io_read_t read = {source->path, source->fd, buffer, length, offset, 0};
+    *got = length;
+    if (io_read_one(&read) != 0)
+    {
+        return read.result;
+    }
+
+    // Short read: keep what the file still holds past offset
+    int fd = source->fd >= 0 ? source->fd : open(source->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat statbuf;
+    int result = fstat(fd, &statbuf) == 0 && (uint64_t)statbuf.st_size < offset + length;
+    if (result)
+    {
+        *got = (uint64_t)statbuf.st_size > offset ? (size_t)((uint64_t)statbuf.st_size - offset) : 0;
+        io_read_t rest = {NULL, fd, buffer, *got, offset, 0};
+        result = *got == 0 || io_read_one(&rest) > 0;
+    }
+    if (fd != source->fd)
+    {
+        close(fd);
+    }
+    return result;
+}
+
+// Concatenates the members of a solid block; members deleted since the scan are
+// dropped and members that shrank keep the bytes they still have
+static int load_solid_block(block_job_t *job)
+{
+    if (!ensure_capacity(&job->input, &job->input_cap, job->input_len ? job->input_len : 1))
+    {
+        return 0;
+    }
+    job->data = job->input;
+    size_t filled = 0;
+    for (size_t m = 0; m < job->member_count; m++)
+    {
+        file_source_t *member = &job->source[m];
+        size_t got = 0;
+        int read = read_available(member, job->input + filled, (size_t)member->size, 0, &got);
+        if (read < 0)
+        {
+            member->missing = 1;
+            continue;
+        }
+        if (!read)
+        {
+            return 0;
+        }
+        member->size = got;
+        filled += got;
+    }
+    job->input_len = filled;
+    return 1;
+}
+
+// Reads a block that is not mapped: small files are opened by the worker itself,
+// so batches of small files also read in parallel. A block of a file that shrank
+// since the scan keeps what is left, so its entry ends early instead of failing.
+static int load_block(block_job_t *job)
+{
+    file_source_t *source = job->source;
+    if (!source || job->data)
+    {
+        return 1;
+    }
+    if (job->member_count > 0)
+    {
+        return load_solid_block(job);
+    }
+    if (!ensure_capacity(&job->input, &job->input_cap, job->input_len ? job->input_len : 1))
+    {
+        return 0;
+    }
+    job->data = job->input;
+
+    size_t got = 0;
+    int read = read_available(source, job->input, job->input_len, job->source_offset, &got);
+    job->missing = read < 0;
+    if (read > 0)
+    {
+        job->input_len = got;
+    }
+    return read > 0;
+}
+
+// Loads, checksums and runs the configured pipeline over one block, or the
+// part of it a scan of the block finds worth running. A block that coding
+// does not shrink is stored as is.
+static void encode_block(block_job_t *job, const fm_config_t *cfg, const bwt_config_t *bwt, bwt_context_t *worker)
+{
+    pipeline_stats_t *stats = cfg->stats ? &job->stats : NULL;
+    double started = stats ? omp_get_wtime() : 0;
+    if (stats)
+    {
+        memset(stats, 0, sizeof(*stats));
+    }
+    int loaded = load_block(job);
+    job->load_seconds = stats ? omp_get_wtime() - started : 0;
+    if (!loaded)
+    {
+        job->status = PIPELINE_STATUS_INVALID_ARGUMENT;
+        return;
+    }
+    job->status = PIPELINE_STATUS_OK;
+    job->encoded_len = 0;
+    if (job->input_len == 0)
+    {
+        return; // empty entry: only its record is written
+    }
+
+    size_t capacity = pipeline_max_encoded_size(cfg->stages, job->input_len);
+    if (!ensure_capacity(&job->encoded, &job->encoded_cap, capacity) ||
+        !ensure_capacity(&job->scratch, &job->scratch_cap, capacity))
+    {
+        job->status = PIPELINE_STATUS_ALLOCATION_FAILURE;
+        return;
+    }
+    job->checksum = crc32c_update(0, job->data, job->input_len);
+    uint32_t stages = cfg->stages;
+    if (cfg->adaptive)
+    {
+        stages = job->stages != FM_STAGES_SCAN ? job->stages
+                                               : pipeline_choose_stages(cfg->stages, job->data, job->input_len);
+    }
+    job->status = pipeline_encode(bwt, worker, stages, job->data, job->input_len,
+                                  job->encoded, &job->encoded_len, job->scratch, &job->block, stats);
+    if (cfg->adaptive && job->status == PIPELINE_STATUS_OK && stages != 0 && job->encoded_len >= job->input_len)
+    {
+        job->status = pipeline_encode(bwt, worker, 0, job->data, job->input_len,
+                                      job->encoded, &job->encoded_len, job->scratch, &job->block, NULL);
+    }
+}
+
+// Archive being written; offset feeds the central directory
+typedef struct
+{
+    FILE *file;
+    uint64_t offset;
+} archive_writer_t;
+
+static int archive_write(archive_writer_t *aw, const void *data, size_t len)
+{
+    if (fwrite(data, 1, len, aw->file) != len)
+    {
+        return 0;
+    }
+    aw->offset += len;
+    return 1;
+}
+
+static int archive_write_u64(archive_writer_t *aw, uint64_t value)
+{
+    return archive_write(aw, &value, sizeof(value));
+}
+
+// Central directory kept in memory until the archive is finished
+typedef struct
+{
+    uint64_t offset; // position of the block record
+    uint64_t length; // decoded bytes
+    uint64_t checksum;
+} dir_block_t;
+
+typedef struct
+{
+    char *name;
+    uint64_t kind;   // FM_RECORD_ENTRY or FM_RECORD_SOLID
+    uint64_t offset; // position of the record holding the entry
+    uint64_t original_size;
+    uint64_t solid_offset; // start of a solid member within its block
+    dir_block_t *blocks;
+    size_t block_count;
+    size_t block_capacity;
+} dir_entry_t;
+
+typedef struct
+{
+    dir_entry_t *entries;
+    size_t count;
+    size_t capacity;
+} directory_t;
+
+static void directory_free(directory_t *dir)
+{
+    for (size_t i = 0; i < dir->count; i++)
+    {
+        free(dir->entries[i].name);
+        free(dir->entries[i].blocks);
+    }
+    free(dir->entries);
+    memset(dir, 0, sizeof(*dir));
+}
+
+static dir_entry_t *directory_add_entry(directory_t *dir, const char *name, uint64_t offset)
+{
+    if (dir->count == dir->capacity)
+    {
+        size_t capacity = dir->capacity ? dir->capacity * 2 : 64;
+        dir_entry_t *entries = (dir_entry_t *)realloc(dir->entries, capacity * sizeof(dir_entry_t));
+        if (!entries)
+        {
+            return NULL;
+        }
+        dir->entries = entries;
+        dir->capacity = capacity;
+    }
+    dir_entry_t *entry = &dir->entries[dir->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->name = strdup(name);
+    if (!entry->name)
+    {
+        return NULL;
+    }
+    entry->kind = FM_RECORD_ENTRY;
+    entry->offset = offset;
+    dir->count++;
+    return entry;
+}
+
+static int directory_add_block(dir_entry_t *entry, uint64_t offset, uint64_t length, uint64_t checksum)
+{
+    if (entry->block_count == entry->block_capacity)
+    {
+        size_t capacity = entry->block_capacity ? entry->block_capacity * 2 : 4;
+        dir_block_t *blocks = (dir_block_t *)realloc(entry->blocks, capacity * sizeof(dir_block_t));
+        if (!blocks)
+        {
+            return 0;
+        }
+        entry->blocks = blocks;
+        entry->block_capacity = capacity;
+    }
+    dir_block_t *block = &entry->blocks[entry->block_count++];
+    block->offset = offset;
+    block->length = length;
+    block->checksum = checksum;
+    entry->original_size += length;
+    return 1;
+}
+
+// Growable byte buffer the directory is serialized into before it is checksummed
+typedef struct
+{
+    uint8_t *data;
+    size_t len;
+    size_t capacity;
+} byte_buffer_t;
+
+static int buffer_put(byte_buffer_t *buf, const void *data, size_t len)
+{
+    if (buf->len + len > buf->capacity)
+    {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (capacity < buf->len + len)
+        {
+            capacity *= 2;
+        }
+        uint8_t *tmp = (uint8_t *)realloc(buf->data, capacity);
+        if (!tmp)
+        {
+            return 0;
+        }
+        buf->data = tmp;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return 1;
+}
+
+static int buffer_put_u64(byte_buffer_t *buf, uint64_t value)
+{
+    return buffer_put(buf, &value, sizeof(value));
+}
+
+// Writes one block record
+static fm_status_t write_block(archive_writer_t *out, const block_job_t *job)
+{
+    // The header fields go out as one write ahead of the payload
+    uint64_t header[5 + BWT_MAX_CHAINS];
+    size_t fields = 0;
+    header[fields++] = (uint64_t)job->input_len;
+    header[fields++] = (uint64_t)job->block.stages;
+    header[fields++] = (uint64_t)job->block.chain_count;
+    for (size_t c = 0; c < job->block.chain_count; c++)
+    {
+        header[fields++] = (uint64_t)job->block.chain_index[c];
+    }
+    header[fields++] = (uint64_t)job->checksum;
+    header[fields++] = (uint64_t)job->encoded_len;
+    if (!archive_write(out, header, fields * sizeof(header[0])) || !archive_write(out, job->encoded, job->encoded_len))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    return FM_STATUS_OK;
+}
+
+// Buffers and bookkeeping shared by every entry of one archive
+typedef struct
+{
+    const fm_config_t *cfg;
+    fm_context_t *ctx; // cfg->context, or local_ctx for this archive only
+    fm_context_t local_ctx;
+    block_job_t *jobs; // taken from ctx on first use
+    bwt_context_t *workers;
+    int max_jobs;
+    int threads;
+    archive_writer_t out;
+    directory_t directory;
+    dir_entry_t *entry;      // entry the ordered writer is currently appending to
+    const char *stream_name; // entry name for blocks pulled from a reader
+} compress_state_t;
+
+// Small files are read whole by the workers; larger ones are mapped once
+#define FM_MAP_THRESHOLD (256 * 1024)
+// A batch holds up to this many blocks per worker when files are small
+#define FM_JOBS_PER_WORKER 16
+
+static block_job_t *batch_jobs(compress_state_t *state)
+{
+    if (!state->jobs)
+    {
+        state->threads = block_parallelism(state->cfg);
+        state->max_jobs = state->threads * FM_JOBS_PER_WORKER;
+        state->workers = context_workers(state->ctx, state->threads);
+        state->jobs = state->workers ? context_block_jobs(state->ctx, state->max_jobs) : NULL;
+    }
+    return state->jobs;
+}
+
+static void release_source(file_source_t *source)
+{
+    io_unmap(&source->map);
+    if (source->fd >= 0)
+    {
+        close(source->fd);
+        source->fd = -1;
+    }
+}
+
+// Writes a solid record and lists each member in the directory
+static fm_status_t write_solid_job(compress_state_t *state, const block_job_t *job)
+{
+    archive_writer_t *out = &state->out;
+    uint64_t record_offset = out->offset;
+    uint64_t present = 0;
+    for (size_t m = 0; m < job->member_count; m++)
+    {
+        present += !job->source[m].missing;
+    }
+    if (present == 0)
+    {
+        return FM_STATUS_OK;
+    }
+    uint64_t header[2] = {FM_RECORD_SOLID, present};
+    if (!archive_write(out, header, sizeof(header)))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    for (size_t m = 0; m < job->member_count; m++)
+    {
+        const file_source_t *member = &job->source[m];
+        uint64_t name_len = strlen(member->name);
+        if (!member->missing &&
+            (!archive_write_u64(out, name_len) || !archive_write(out, member->name, name_len) ||
+             !archive_write_u64(out, member->size)))
+        {
+            return FM_STATUS_IO_ERROR;
+        }
+    }
+
+    uint64_t block_offset = out->offset;
+    fm_status_t status = write_block(out, job);
+    if (status != FM_STATUS_OK)
+    {
+        return status;
+    }
+
+    uint64_t solid_offset = 0;
+    for (size_t m = 0; m < job->member_count; m++)
+    {
+        const file_source_t *member = &job->source[m];
+        if (member->missing)
+        {
+            continue;
+        }
+        dir_entry_t *entry = directory_add_entry(&state->directory, member->name, record_offset);
+        if (!entry || !directory_add_block(entry, block_offset, job->input_len, job->checksum))
+        {
+            return FM_STATUS_ALLOCATION_FAILURE;
+        }
+        job->source[m].entry = state->directory.count - 1;
+        entry->kind = FM_RECORD_SOLID;
+        entry->original_size = member->size;
+        entry->solid_offset = solid_offset;
+        solid_offset += member->size;
+    }
+    return FM_STATUS_OK;
+}
+
+// Appends one finished block to the archive; runs in job order
+static fm_status_t write_job(compress_state_t *state, block_job_t *job)
+{
+    if (job->status != PIPELINE_STATUS_OK)
+    {
+        // A small file deleted after the scan is skipped, as unreadable files always were
+        if (job->missing && job->first_in_entry && job->last_in_entry)
+        {
+            return FM_STATUS_OK;
+        }
+        if (job->source)
+        {
+            return FM_STATUS_IO_ERROR;
+        }
+        return job->status == PIPELINE_STATUS_ALLOCATION_FAILURE ? FM_STATUS_ALLOCATION_FAILURE : FM_STATUS_ERROR;
+    }
+
+    if (job->member_count > 0)
+    {
+        return write_solid_job(state, job);
+    }
+
+    archive_writer_t *out = &state->out;
+    if (job->first_in_entry)
+    {
+        const char *name = job->source ? job->source->name : state->stream_name;
+        state->entry = directory_add_entry(&state->directory, name, out->offset);
+        if (!state->entry)
+        {
+            return FM_STATUS_ALLOCATION_FAILURE;
+        }
+        if (job->source)
+        {
+            job->source->entry = state->directory.count - 1;
+        }
+        uint64_t header[2] = {FM_RECORD_ENTRY, strlen(name)};
+        if (!archive_write(out, header, sizeof(header)) || !archive_write(out, name, (size_t)header[1]))
+        {
+            return FM_STATUS_IO_ERROR;
+        }
+    }
+    if (job->input_len > 0)
+    {
+        if (!directory_add_block(state->entry, out->offset, job->input_len, job->checksum))
+        {
+            return FM_STATUS_ALLOCATION_FAILURE;
+        }
+        fm_status_t status = write_block(out, job);
+        if (status != FM_STATUS_OK)
+        {
+            return status;
+        }
+    }
+    if (job->last_in_entry && !archive_write_u64(out, 0))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    return FM_STATUS_OK;
+}
+
+// Counts the reads a batch needs: one per unmapped file block or solid member
+static int batch_read_count(const block_job_t *jobs, int filled)
+{
+    int count = 0;
+    for (int i = 0; i < filled; i++)
+    {
+        if (jobs[i].source && !jobs[i].data)
+        {
+            count += jobs[i].member_count > 0 ? (int)jobs[i].member_count : 1;
+        }
+    }
+    return count;
+}
+
+/*
+  Reads every unmapped block of the batch before it is encoded, keeping
+  cfg->io_depth opens and reads in flight instead of one per worker. A
+  block whose reads all succeed is marked loaded; anything else is left
+  for load_block to retry in the worker, which also sorts out files that
+  vanished or shrank since the scan.
+*/
+static void prefetch_batch(compress_state_t *state, int filled)
+{
+    block_job_t *jobs = state->jobs;
+    int count = state->cfg->io_depth > 1 ? batch_read_count(jobs, filled) : 0;
+    io_read_t *reads = count > 1 ? context_reads(state->ctx, count) : NULL;
+    if (!reads)
+    {
+        return;
+    }
+
+    int r = 0;
+    for (int i = 0; i < filled; i++)
+    {
+        block_job_t *job = &jobs[i];
+        if (!job->source || job->data)
+        {
+            continue;
+        }
+        if (!ensure_capacity(&job->input, &job->input_cap, job->input_len ? job->input_len : 1))
+        {
+            count = r; // this job and the rest load in the workers, which report the failure
+            break;
+        }
+        if (job->member_count == 0)
+        {
+            reads[r++] = (io_read_t){job->source->path, job->source->fd, job->input, job->input_len,
+                                     job->source_offset, 0};
+            continue;
+        }
+        size_t offset = 0;
+        for (size_t m = 0; m < job->member_count; m++)
+        {
+            const file_source_t *member = &job->source[m];
+            reads[r++] = (io_read_t){member->path, -1, job->input + offset, (size_t)member->size, 0, 0};
+            offset += (size_t)member->size;
+        }
+    }
+    double started = state->cfg->stats ? omp_get_wtime() : 0;
+    io_read_batch(reads, (size_t)r, state->cfg->io_depth, state->cfg->io_backend);
+    if (state->cfg->stats)
+    {
+        state->cfg->stats->read_seconds += omp_get_wtime() - started;
+    }
+
+    r = 0;
+    for (int i = 0; i < filled && r < count; i++)
+    {
+        block_job_t *job = &jobs[i];
+        if (!job->source || job->data)
+        {
+            continue;
+        }
+        if (job->member_count == 0)
+        {
+            job->data = reads[r++].result > 0 ? job->input : NULL;
+            continue;
+        }
+
+        // Members that vanished are dropped and the rest closed up, as load_solid_block does
+        const io_read_t *member_reads = &reads[r];
+        r += (int)job->member_count;
+        int complete = 1;
+        for (size_t m = 0; m < job->member_count; m++)
+        {
+            complete &= member_reads[m].result != 0;
+        }
+        if (!complete)
+        {
+            continue;
+        }
+        size_t filled_len = 0;
+        for (size_t m = 0; m < job->member_count; m++)
+        {
+            file_source_t *member = &job->source[m];
+            if (member_reads[m].result < 0)
+            {
+                member->missing = 1;
+                continue;
+            }
+            memmove(job->input + filled_len, member_reads[m].buffer, (size_t)member->size);
+            filled_len += (size_t)member->size;
+        }
+        job->input_len = filled_len;
+        job->data = job->input;
+    }
+}
+
+/*
+  Encodes a batch of jobs on the worker team and appends them in order.
+  Workers take jobs dynamically, so a few large blocks do not hold up many
+  small ones, and the ordered section makes whichever thread finishes the
+  next job in sequence the archive writer while the others keep encoding.
+*/
+static fm_status_t run_batch(compress_state_t *state, int filled, fm_status_t status)
+{
+    block_job_t *jobs = state->jobs;
+    thread_split_t split = split_threads(state->threads, filled);
+    bwt_config_t bwt = state->cfg->bwt;
+    bwt.threads = split.inner;
+
+#pragma omp parallel for ordered schedule(dynamic, 1) num_threads(split.workers) if (split.workers > 1)
+    for (int i = 0; i < filled; i++)
+    {
+        encode_block(&jobs[i], state->cfg, &bwt, &state->workers[omp_get_thread_num()]);
+
+#pragma omp ordered
+        {
+            fm_stats_t *stats = state->cfg->stats;
+            double started = stats ? omp_get_wtime() : 0;
+            if (status == FM_STATUS_OK)
+            {
+                status = write_job(state, &jobs[i]);
+            }
+            if (stats)
+            {
+                stats->write_seconds += omp_get_wtime() - started;
+                stats->read_seconds += jobs[i].load_seconds;
+                if (jobs[i].status == PIPELINE_STATUS_OK && jobs[i].input_len > 0)
+                {
+                    stats_add_block(stats, &jobs[i].stats, jobs[i].block.stages, jobs[i].input_len);
+                }
+            }
+            // The file's last block is written, so nothing reads its mapping anymore.
+            // Solid members are read whole by the worker and hold nothing open.
+            if (jobs[i].source && jobs[i].member_count == 0)
+            {
+                if (jobs[i].last_in_entry)
+                {
+                    release_source(jobs[i].source);
+                }
+                else if (jobs[i].source->map.data && jobs[i].input_len > 0)
+                {
+                    io_map_release(&jobs[i].source->map, (size_t)jobs[i].source_offset, jobs[i].input_len);
+                }
+            }
+        }
+    }
+    return status;
+}
+
+static size_t read_file_cb(void *user_ctx, uint8_t *buffer, size_t max_len)
+{
+    return fread(buffer, 1, max_len, (FILE *)user_ctx);
+}
+
+// Pulls from reader until the block is full or the input ends
+static size_t fill_block(bwt_read_cb reader, void *reader_ctx, uint8_t *buffer, size_t block_size)
+{
+    size_t filled = 0;
+    while (filled < block_size)
+    {
+        size_t got = reader(reader_ctx, buffer + filled, block_size - filled);
+        if (got == 0)
+        {
+            break;
+        }
+        filled += got;
+    }
+    return filled;
+}
+
+/*
+  Compresses everything reader yields as one entry. The input is consumed
+  strictly sequentially, one batch of blocks (one per worker) at a time,
+  so memory stays bounded by the batch whatever the input size.
+*/
+static fm_status_t compress_stream_entry(bwt_read_cb reader, void *reader_ctx, compress_state_t *state)
+{
+    block_job_t *jobs = batch_jobs(state);
+    if (!jobs)
+    {
+        return FM_STATUS_ALLOCATION_FAILURE;
+    }
+
+    size_t block_size = block_size_of(state->cfg);
+    fm_status_t status = FM_STATUS_OK;
+    int first = 1;
+    int at_end = 0;
+    while (!at_end && status == FM_STATUS_OK)
+    {
+        int filled = 0;
+        while (filled < state->threads && !at_end)
+        {
+            block_job_t *job = &jobs[filled];
+            if (!ensure_capacity(&job->input, &job->input_cap, block_size))
+            {
+                return FM_STATUS_ALLOCATION_FAILURE;
+            }
+            size_t len = fill_block(reader, reader_ctx, job->input, block_size);
+            at_end = len < block_size;
+            // An empty read still ends the entry unless an earlier block of this batch can
+            if (len == 0 && filled > 0)
+            {
+                jobs[filled - 1].last_in_entry = 1;
+                break;
+            }
+            job->data = job->input;
+            job->input_len = len;
+            job->source = NULL;
+            job->member_count = 0;
+            job->stages = FM_STAGES_SCAN;
+            job->first_in_entry = first;
+            job->last_in_entry = at_end;
+            job->missing = 0;
+            first = 0;
+            filled++;
+        }
+        status = run_batch(state, filled, status);
+    }
+    return status;
+}
+
+typedef struct
+{
+    file_source_t *files;
+    size_t count;
+    size_t capacity;
+} file_list_t;
+
+static void file_list_free(file_list_t *list)
+{
+    for (size_t i = 0; i < list->count; i++)
+    {
+        release_source(&list->files[i]);
+        free(list->files[i].path);
+        free(list->files[i].name);
+    }
+    free(list->files);
+    memset(list, 0, sizeof(*list));
+}
+
+// Thread-safe append used by the scan tasks
+static int file_list_add(file_list_t *list, const char *path, const char *name, uint64_t size)
+{
+    char *path_copy = strdup(path);
+    char *name_copy = strdup(name);
+    int ok = path_copy && name_copy;
+#pragma omp critical(file_list)
+    {
+        if (ok && list->count == list->capacity)
+        {
+            size_t capacity = list->capacity ? list->capacity * 2 : 256;
+            file_source_t *files = (file_source_t *)realloc(list->files, capacity * sizeof(file_source_t));
+            if (files)
+            {
+                list->files = files;
+                list->capacity = capacity;
+            }
+            else
+            {
+                ok = 0;
+            }
+        }
+        if (ok)
+        {
+            file_source_t *source = &list->files[list->count++];
+            memset(source, 0, sizeof(*source));
+            source->path = path_copy;
+            source->name = name_copy;
+            source->size = size;
+            source->fd = -1;
+            source->id = list->count - 1;
+            source->original = SIZE_MAX;
+            source->entry = SIZE_MAX;
+        }
+    }
+    if (!ok)
+    {
+        free(path_copy);
+        free(name_copy);
+    }
+    return ok;
+}
+
+/*
+  Collects the regular files under dir_path. Every subdirectory becomes an
+  OpenMP task, so wide trees are listed and stat'ed by the whole team.
+  Entries that cannot be stat'ed are skipped, as before.
+*/
+static void scan_directory(const char *dir_path, size_t base_len, file_list_t *list, int *failed)
+{
+    DIR *dir = opendir(dir_path);
+    if (!dir)
+    {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        char full_path[MAX_PATH];
+        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
+
+        struct stat statbuf;
+        if (fstatat(dirfd(dir), entry->d_name, &statbuf, 0) != 0)
+        {
+            continue;
+        }
+
+        if (S_ISDIR(statbuf.st_mode))
+        {
+            char *sub_path = strdup(full_path);
+            if (!sub_path)
+            {
+#pragma omp atomic write
+                *failed = 1;
+                continue;
+            }
+#pragma omp task firstprivate(sub_path)
+            {
+                scan_directory(sub_path, base_len, list, failed);
+                free(sub_path);
+            }
+        }
+        else if (S_ISREG(statbuf.st_mode))
+        {
+            // Entry names are relative to the directory being compressed
+            const char *relative_path = strlen(full_path) > base_len + 1 ? full_path + base_len + 1 : entry->d_name;
+            if (!file_list_add(list, full_path, relative_path, (uint64_t)statbuf.st_size))
+            {
+#pragma omp atomic write
+                *failed = 1;
+            }
+        }
+    }
+
+    closedir(dir);
+}
+
+// Largest files first so their blocks spread over the team; small files trail and batch up.
+// Duplicates, which are stored as references, come last.
+static int compare_sources(const void *a, const void *b)
+{
+    const file_source_t *fa = (const file_source_t *)a;
+    const file_source_t *fb = (const file_source_t *)b;
+    int duplicate_a = fa->original != SIZE_MAX;
+    int duplicate_b = fb->original != SIZE_MAX;
+    if (duplicate_a != duplicate_b)
+    {
+        return duplicate_a - duplicate_b;
+    }
+    if (fa->size != fb->size)
+    {
+        return fa->size < fb->size ? 1 : -1;
+    }
+    return strcmp(fa->name, fb->name);
+}
+
+// Dedup order: equal sizes and hashes become adjacent
+static int compare_hashes(const void *a, const void *b)
+{
+    const file_source_t *fa = (const file_source_t *)a;
+    const file_source_t *fb = (const file_source_t *)b;
+    if (fa->size != fb->size)
+    {
+        return fa->size < fb->size ? 1 : -1;
+    }
+    if (fa->hashed != fb->hashed)
+    {
+        return fb->hashed - fa->hashed;
+    }
+    if (fa->hash != fb->hash)
+    {
+        return fa->hash < fb->hash ? -1 : 1;
+    }
+    return strcmp(fa->name, fb->name);
+}
+
+// Checksums a whole file through 'buffer' (BUFFER_SIZE bytes); 0 when it cannot be read in full
+static int hash_source(file_source_t *source, uint8_t *buffer)
+{
+    file_source_t local = *source;
+    if ((local.fd = open(source->path, O_RDONLY)) < 0)
+    {
+        return 0;
+    }
+    uint32_t hash = 0;
+    int ok = 1;
+    for (uint64_t offset = 0; ok && offset < local.size; offset += BUFFER_SIZE)
+    {
+        size_t length = local.size - offset < BUFFER_SIZE ? (size_t)(local.size - offset) : BUFFER_SIZE;
+        ok = read_source(&local, buffer, length, offset) > 0;
+        hash = crc32c_update(hash, buffer, length);
+    }
+    close(local.fd);
+    source->hash = hash;
+    return ok;
+}
+
+// Compares two files of equal size byte for byte through two BUFFER_SIZE buffers
+static int same_content(const file_source_t *a, const file_source_t *b, uint8_t *buffer)
+{
+    file_source_t local_a = *a;
+    file_source_t local_b = *b;
+    local_a.fd = open(a->path, O_RDONLY);
+    local_b.fd = open(b->path, O_RDONLY);
+    int same = local_a.fd >= 0 && local_b.fd >= 0;
+    for (uint64_t offset = 0; same && offset < a->size; offset += BUFFER_SIZE)
+    {
+        size_t length = a->size - offset < BUFFER_SIZE ? (size_t)(a->size - offset) : BUFFER_SIZE;
+        same = read_source(&local_a, buffer, length, offset) > 0 &&
+               read_source(&local_b, buffer + BUFFER_SIZE, length, offset) > 0 &&
+               memcmp(buffer, buffer + BUFFER_SIZE, length) == 0;
+    }
+    if (local_a.fd >= 0)
+    {
+        close(local_a.fd);
+    }
+    if (local_b.fd >= 0)
+    {
+        close(local_b.fd);
+    }
+    return same;
+}
+
+/*
+  Marks files whose bytes equal an earlier file's by setting 'original'.
+  Only sizes shared by several files are hashed, and every hash match is
+  confirmed byte for byte, so a CRC collision costs a comparison but never
+  a wrong reference. Both passes read files on the whole team.
+*/
+static void find_duplicates(file_list_t *list, int threads)
+{
+    file_source_t *files = list->files;
+    size_t count = list->count;
+    qsort(files, count, sizeof(file_source_t), compare_hashes); // nothing hashed yet: by size
+#pragma omp parallel num_threads(threads)
+    {
+        uint8_t *buffer = (uint8_t *)malloc(BUFFER_SIZE);
+#pragma omp for schedule(dynamic, 16)
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t size = files[i].size;
+            int shared = (i > 0 && files[i - 1].size == size) || (i + 1 < count && files[i + 1].size == size);
+            files[i].hashed = buffer && size > 0 && shared && hash_source(&files[i], buffer);
+        }
+        free(buffer);
+    }
+    qsort(files, count, sizeof(file_source_t), compare_hashes);
+
+    // Each file is checked against the first file of its size and hash
+    size_t lead = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!files[i].hashed)
+        {
+            continue;
+        }
+        if (i == 0 || !files[i - 1].hashed || files[i - 1].size != files[i].size || files[i - 1].hash != files[i].hash)
+        {
+            lead = i;
+        }
+        files[i].original = lead; // candidate index, turned into an id below
+    }
+#pragma omp parallel num_threads(threads)
+    {
+        uint8_t *buffer = (uint8_t *)malloc(2 * (size_t)BUFFER_SIZE);
+#pragma omp for schedule(dynamic, 16)
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t candidate = files[i].original;
+            if (candidate == SIZE_MAX)
+            {
+                continue;
+            }
+            int duplicate = candidate != i && buffer && same_content(&files[candidate], &files[i], buffer);
+            files[i].original = duplicate ? files[candidate].id : SIZE_MAX;
+        }
+        free(buffer);
+    }
+}
+
+static const char *extension_of(const char *name)
+{
+    const char *base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    const char *dot = strrchr(base, '.');
+    return dot && dot != base ? dot + 1 : "";
+}
+
+// Solid order: same extension, then same base name, lands in the same block
+static int compare_solid(const void *a, const void *b)
+{
+    const file_source_t *fa = (const file_source_t *)a;
+    const file_source_t *fb = (const file_source_t *)b;
+    int cmp = strcmp(extension_of(fa->name), extension_of(fb->name));
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+    const char *base_a = strrchr(fa->name, '/');
+    const char *base_b = strrchr(fb->name, '/');
+    cmp = strcmp(base_a ? base_a + 1 : fa->name, base_b ? base_b + 1 : fb->name);
+    return cmp != 0 ? cmp : strcmp(fa->name, fb->name);
+}
+
+/*
+  Orders the list for compression: large files first by size, then the
+  small non-empty files that share solid blocks, sorted by extension and
+  name so similar content is adjacent, then empty files, then duplicates
+  from *unique_end on. Returns the range of solid candidates as
+  [solid_begin, solid_end) (empty when fewer than two).
+*/
+static void order_file_list(file_list_t *list, const fm_config_t *cfg, size_t *solid_begin, size_t *solid_end,
+                            size_t *unique_end)
+{
+    if (cfg->dedup)
+    {
+        find_duplicates(list, block_parallelism(cfg));
+    }
+    qsort(list->files, list->count, sizeof(file_source_t), compare_sources);
+
+    size_t block_size = block_size_of(cfg);
+    size_t limit = cfg->solid_max_file < block_size ? cfg->solid_max_file : block_size;
+    size_t end = list->count;
+    while (end > 0 && list->files[end - 1].original != SIZE_MAX)
+    {
+        end--;
+    }
+    *unique_end = end;
+    while (end > 0 && list->files[end - 1].size == 0)
+    {
+        end--;
+    }
+    size_t begin = end;
+    while (begin > 0 && list->files[begin - 1].size <= limit)
+    {
+        begin--;
+    }
+    if (limit == 0 || end - begin < 2)
+    {
+        begin = end;
+    }
+    qsort(list->files + begin, end - begin, sizeof(file_source_t), compare_solid);
+    *solid_begin = begin;
+    *solid_end = end;
+}
+
+/*
+  Compresses the ordered files. Each batch takes up to one block_size of
+  input per worker: a handful of blocks while large files last, then
+  solid blocks of many small files, then the remaining small entries.
+  With cfg->adaptive, a span of a mapped file that scans as stored or
+  run-length data becomes one block of up to wide_block_size.
+*/
+static fm_status_t compress_file_list(file_list_t *list, size_t solid_begin, size_t solid_end,
+                                      compress_state_t *state)
+{
+    block_job_t *jobs = batch_jobs(state);
+    if (!jobs)
+    {
+        return FM_STATUS_ALLOCATION_FAILURE;
+    }
+
+    size_t block_size = block_size_of(state->cfg);
+    size_t wide_size = state->cfg->adaptive ? wide_block_size(state->cfg, block_size) : block_size;
+    uint64_t budget = (uint64_t)block_size * (uint64_t)state->threads;
+    size_t next_file = 0;
+    uint64_t next_offset = 0;
+    fm_status_t status = FM_STATUS_OK;
+
+    while (next_file < list->count && status == FM_STATUS_OK)
+    {
+        int filled = 0;
+        uint64_t batch_bytes = 0;
+        while (filled < state->max_jobs && batch_bytes < budget && next_file < list->count)
+        {
+            file_source_t *source = &list->files[next_file];
+            block_job_t *job = &jobs[filled];
+            job->member_count = 0;
+            job->missing = 0;
+            job->stages = FM_STAGES_SCAN;
+
+            if (next_file >= solid_begin && next_file < solid_end)
+            {
+                // Pack consecutive small files up to one block
+                size_t members = 0;
+                uint64_t bytes = 0;
+                while (next_file + members < solid_end && members < FM_SOLID_MAX_MEMBERS &&
+                       bytes + source[members].size <= block_size)
+                {
+                    bytes += source[members].size;
+                    members++;
+                }
+                if (members > 1)
+                {
+                    job->member_count = members;
+                    job->input_len = (size_t)bytes;
+                    job->source = source;
+                    job->source_offset = 0;
+                    job->data = NULL;
+                    job->first_in_entry = 1;
+                    job->last_in_entry = 1;
+                    batch_bytes += bytes;
+                    next_file += members;
+                    filled++;
+                    continue;
+                }
+            }
+
+            if (next_offset == 0 && source->size > FM_MAP_THRESHOLD)
+            {
+                source->fd = open(source->path, O_RDONLY);
+                if (source->fd < 0)
+                {
+                    next_file++; // vanished since the scan: skip it
+                    continue;
+                }
+                // Blocks are cut from the size the file has now, which the scan may have missed
+                struct stat statbuf;
+                if (io_map_fd(source->fd, &source->map) == 0)
+                {
+                    source->size = source->map.size;
+                }
+                else if (fstat(source->fd, &statbuf) == 0)
+                {
+                    source->size = (uint64_t)statbuf.st_size; // emptied, or not mappable: read it instead
+                }
+                else
+                {
+                    release_source(source);
+                    next_file++;
+                    continue;
+                }
+            }
+
+            uint64_t left = source->size - next_offset;
+            job->input_len = left < block_size ? (size_t)left : block_size;
+            if (left > block_size && wide_size > block_size && source->map.data)
+            {
+                // Sized from a scan of the wider span: it stays one block if the BWT would skip it
+                size_t wide = left < wide_size ? (size_t)left : wide_size;
+                uint32_t stages = pipeline_choose_stages(state->cfg->stages, source->map.data + next_offset, wide);
+                if (!(stages & PIPELINE_STAGE_BWT))
+                {
+                    job->input_len = wide;
+                    job->stages = stages;
+                }
+            }
+            job->source = source;
+            job->source_offset = next_offset;
+            job->data = source->map.data ? source->map.data + next_offset : NULL;
+            job->first_in_entry = next_offset == 0;
+            job->last_in_entry = left == job->input_len;
+            batch_bytes += job->input_len;
+            filled++;
+
+            next_offset += job->input_len;
+            if (job->last_in_entry)
+            {
+                next_file++;
+                next_offset = 0;
+            }
+        }
+        prefetch_batch(state, filled);
+        status = run_batch(state, filled, status);
+    }
+    return status;
+}
+
+/*
+  Appends a link record per duplicate in files[unique_end..). Its directory
+  entry repeats the original's, blocks included, so -x extracts it straight
+  from the original's data. A duplicate whose original vanished before it
+  was written is compressed as an ordinary file instead.
+*/
+static fm_status_t write_duplicates(file_list_t *list, size_t unique_end, compress_state_t *state)
+{
+    if (unique_end == list->count)
+    {
+        return FM_STATUS_OK;
+    }
+    const char **original_name = (const char **)calloc(list->count, sizeof(char *));
+    size_t *original_entry = (size_t *)malloc(list->count * sizeof(size_t));
+    if (!original_name || !original_entry)
+    {
+        free(original_name);
+        free(original_entry);
+        return FM_STATUS_ALLOCATION_FAILURE;
+    }
+    for (size_t i = 0; i < unique_end; i++)
+    {
+        original_name[list->files[i].id] = list->files[i].name;
+        original_entry[list->files[i].id] = list->files[i].entry;
+    }
+
+    // Orphans move to the front of the duplicates and go through the normal path
+    size_t orphans = unique_end;
+    for (size_t i = unique_end; i < list->count; i++)
+    {
+        file_source_t *duplicate = &list->files[i];
+        if (original_entry[duplicate->original] == SIZE_MAX)
+        {
+            file_source_t orphan = *duplicate;
+            orphan.original = SIZE_MAX;
+            *duplicate = list->files[orphans];
+            list->files[orphans++] = orphan;
+        }
+    }
+    file_list_t orphan_list = {list->files + unique_end, orphans - unique_end, orphans - unique_end};
+    fm_status_t status = compress_file_list(&orphan_list, 0, 0, state);
+
+    archive_writer_t *out = &state->out;
+    for (size_t i = orphans; i < list->count && status == FM_STATUS_OK; i++)
+    {
+        const file_source_t *duplicate = &list->files[i];
+        const char *target = original_name[duplicate->original];
+        uint64_t name_len = strlen(duplicate->name);
+        uint64_t target_len = strlen(target);
+        if (!archive_write_u64(out, FM_RECORD_LINK) || !archive_write_u64(out, name_len) ||
+            !archive_write(out, duplicate->name, name_len) || !archive_write_u64(out, target_len) ||
+            !archive_write(out, target, target_len))
+        {
+            status = FM_STATUS_IO_ERROR;
+            break;
+        }
+
+        dir_entry_t *entry = directory_add_entry(&state->directory, duplicate->name, 0);
+        const dir_entry_t *source = &state->directory.entries[original_entry[duplicate->original]];
+        if (!entry)
+        {
+            status = FM_STATUS_ALLOCATION_FAILURE;
+            break;
+        }
+        for (size_t b = 0; b < source->block_count && status == FM_STATUS_OK; b++)
+        {
+            if (!directory_add_block(entry, source->blocks[b].offset, source->blocks[b].length,
+                                     source->blocks[b].checksum))
+            {
+                status = FM_STATUS_ALLOCATION_FAILURE;
+            }
+        }
+        entry->kind = source->kind;
+        entry->offset = source->offset;
+        entry->original_size = source->original_size;
+        entry->solid_offset = source->solid_offset;
+    }
+    free(original_name);
+    free(original_entry);
+    return status;
+}
+
+fm_status_t fm_compress(const char *input_path, const char *output_path)
+{
+    return fm_compress_ex(input_path, output_path, NULL);
+}
+
+// Opens the archive for writing ("-" selects stdout) and writes its header
+static fm_status_t begin_archive(compress_state_t *state, const fm_config_t *cfg, const char *output_path)
+{
+    memset(state, 0, sizeof(*state));
+    state->cfg = cfg;
+    state->ctx = acquire_context(cfg, &state->local_ctx);
+    stats_begin(cfg->stats, cfg, state->ctx);
+    state->out.file = strcmp(output_path, "-") == 0 ? stdout : fopen(output_path, "wb");
+    if (!state->out.file)
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    // Record headers are many small writes; a large buffer turns them into few system calls
+    if (state->out.file != stdout)
+    {
+        setvbuf(state->out.file, NULL, _IOFBF, BUFFER_SIZE);
+    }
+    uint32_t version = FM_FORMAT_VERSION;
+    if (!archive_write(&state->out, FM_MAGIC, FM_MAGIC_SIZE) || !archive_write(&state->out, &version, sizeof(version)))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    return FM_STATUS_OK;
+}
+
+// Serializes the central directory record
+static int serialize_directory(const directory_t *dir, byte_buffer_t *buf)
+{
+    if (!buffer_put_u64(buf, FM_RECORD_DIRECTORY) || !buffer_put_u64(buf, dir->count))
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < dir->count; i++)
+    {
+        const dir_entry_t *entry = &dir->entries[i];
+        uint64_t name_len = strlen(entry->name);
+        if (!buffer_put_u64(buf, entry->kind) || !buffer_put_u64(buf, name_len) ||
+            !buffer_put(buf, entry->name, name_len) || !buffer_put_u64(buf, entry->offset) ||
+            !buffer_put_u64(buf, entry->original_size) || !buffer_put_u64(buf, entry->solid_offset) ||
+            !buffer_put_u64(buf, entry->block_count))
+        {
+            return 0;
+        }
+        for (size_t b = 0; b < entry->block_count; b++)
+        {
+            if (!buffer_put_u64(buf, entry->blocks[b].offset) || !buffer_put_u64(buf, entry->blocks[b].length) ||
+                !buffer_put_u64(buf, entry->blocks[b].checksum))
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Appends the central directory and footer, then releases everything the archive held
+static fm_status_t finish_archive(compress_state_t *state, fm_status_t status)
+{
+    if (status == FM_STATUS_OK && state->out.file)
+    {
+        byte_buffer_t buf = {NULL, 0, 0};
+        uint64_t directory_offset = state->out.offset;
+        if (!serialize_directory(&state->directory, &buf))
+        {
+            status = FM_STATUS_ALLOCATION_FAILURE;
+        }
+        else
+        {
+            uint32_t version = FM_FORMAT_VERSION;
+            if (!archive_write(&state->out, buf.data, buf.len) || !archive_write_u64(&state->out, directory_offset) ||
+                !archive_write_u64(&state->out, crc32c_update(0, buf.data, buf.len)) ||
+                !archive_write(&state->out, FM_MAGIC, FM_MAGIC_SIZE) ||
+                !archive_write(&state->out, &version, sizeof(version)))
+            {
+                status = FM_STATUS_IO_ERROR;
+            }
+        }
+        free(buf.data);
+    }
+
+    if (state->out.file)
+    {
+        FILE *file = state->out.file;
+        int failed = (file == stdout) ? fflush(file) != 0 : fclose(file) != 0;
+        if (status == FM_STATUS_OK && failed)
+        {
+            status = FM_STATUS_IO_ERROR;
+        }
+    }
+    if (state->cfg->stats)
+    {
+        state->cfg->stats->files = state->directory.count;
+        stats_finish(state->cfg->stats, state->ctx, state->out.offset);
+    }
+    release_context(state->ctx, &state->local_ctx);
+    directory_free(&state->directory);
+    return status;
+}
+
+fm_status_t fm_compress_ex(const char *input_path, const char *output_path, const fm_config_t *cfg)
+{
+    if (!input_path || !output_path)
+    {
+        return FM_STATUS_INVALID_ARGUMENT;
+    }
+
+    // Standard input becomes a single entry named after FM_STDIN_ENTRY
+    if (strcmp(input_path, "-") == 0)
+    {
+        return fm_compress_stream(read_file_cb, stdin, FM_STDIN_ENTRY, output_path, cfg);
+    }
+
+    fm_config_t local_cfg;
+    if (!cfg)
+    {
+        fm_config_init(&local_cfg);
+        cfg = &local_cfg;
+    }
+    fm_config_t planned;
+    cfg = plan_compress_memory(cfg, &planned);
+
+    // List the input: the file itself, or every regular file under the directory
+    file_list_t list = {NULL, 0, 0};
+    int failed = 0;
+    if (fm_get_path_type(input_path) == FM_TYPE_FILE)
+    {
+        struct stat statbuf;
+        if (stat(input_path, &statbuf) != 0)
+        {
+            return FM_STATUS_FILE_NOT_FOUND;
+        }
+        char *path_copy = strdup(input_path);
+        failed = !path_copy || !file_list_add(&list, input_path, basename(path_copy), (uint64_t)statbuf.st_size);
+        free(path_copy);
+    }
+    else
+    {
+        if (access(input_path, R_OK | X_OK) != 0)
+        {
+            return FM_STATUS_FILE_NOT_FOUND;
+        }
+#pragma omp parallel num_threads(block_parallelism(cfg))
+#pragma omp single
+        scan_directory(input_path, strlen(input_path), &list, &failed);
+    }
+    if (failed)
+    {
+        file_list_free(&list);
+        return FM_STATUS_ALLOCATION_FAILURE;
+    }
+
+    size_t solid_begin = 0;
+    size_t solid_end = 0;
+    size_t unique_end = 0;
+    order_file_list(&list, cfg, &solid_begin, &solid_end, &unique_end);
+
+    compress_state_t state;
+    fm_status_t status = begin_archive(&state, cfg, output_path);
+    if (status == FM_STATUS_OK)
+    {
+        file_list_t unique = {list.files, unique_end, unique_end};
+        status = compress_file_list(&unique, solid_begin, solid_end, &state);
+    }
+    if (status == FM_STATUS_OK)
+    {
+        status = write_duplicates(&list, unique_end, &state);
+    }
+    file_list_free(&list);
+    return finish_archive(&state, status);
+}
+
+fm_status_t fm_compress_stream(bwt_read_cb reader, void *reader_ctx, const char *entry_name,
+                               const char *output_path, const fm_config_t *cfg)
+{
+    if (!reader || !entry_name || !output_path)
+    {
+        return FM_STATUS_INVALID_ARGUMENT;
+    }
+
+    fm_config_t local_cfg;
+    if (!cfg)
+    {
+        fm_config_init(&local_cfg);
+        cfg = &local_cfg;
+    }
+    fm_config_t planned;
+    cfg = plan_compress_memory(cfg, &planned);
+
+    compress_state_t state;
+    fm_status_t status = begin_archive(&state, cfg, output_path);
+    state.stream_name = entry_name;
+    if (status == FM_STATUS_OK)
+    {
+        status = compress_stream_entry(reader, reader_ctx, &state);
+    }
+    if (status == FM_STATUS_OK && reader == read_file_cb && ferror((FILE *)reader_ctx))
+    {
+        status = FM_STATUS_IO_ERROR;
+    }
+    return finish_archive(&state, status);
+}
+
+// Create necessary directories
+static fm_status_t create_directories(const char *filepath)
+{
+    if (!filepath || filepath[0] == '\0')
+    {
+        return FM_STATUS_OK;
+    }
+
+    char *path = (char *)malloc(strlen(filepath) + 1);
+    if (!path)
+    {
+        return FM_STATUS_ALLOCATION_FAILURE;
+    }
+
+    strcpy(path, filepath);
+    char *dir = dirname(path);
+
+    // Create directories recursively
+    char temp[MAX_PATH];
+    strcpy(temp, dir);
+
+    for (size_t i = 1; i < strlen(temp); i++)
+    {
+        if (temp[i] == '/')
+        {
+            temp[i] = '\0';
+            mkdir(temp, 0755);
+            temp[i] = '/';
+        }
+    }
+    mkdir(temp, 0755);
+
+    free(path);
+    return FM_STATUS_OK;
+}
+
+/*
+  Reader over the archive. Regular files are mapped, so block payloads are
+  decoded straight from the page cache; stdin and pipes go through stdio
+  and can only be read front to back.
+*/
+typedef struct
+{
+    FILE *file;
+    io_map_t map;
+    size_t pos;      // read position: within the mapping, or bytes read through stdio
+    size_t released; // prefix of the mapping already handed back to the kernel
+} archive_reader_t;
+
+// Copies up to len bytes; returns how many were available
+static size_t archive_read(archive_reader_t *ar, void *dst, size_t len)
+{
+    if (!ar->map.data)
+    {
+        size_t got = fread(dst, 1, len, ar->file);
+        ar->pos += got;
+        return got;
+    }
+    size_t avail = ar->map.size - ar->pos;
+    if (len > avail)
+    {
+        len = avail;
+    }
+    memcpy(dst, ar->map.data + ar->pos, len);
+    ar->pos += len;
+    return len;
+}
+
+static int archive_read_u64(archive_reader_t *ar, uint64_t *value)
+{
+    return archive_read(ar, value, sizeof(*value)) == sizeof(*value);
+}
+
+// Returns the next len bytes: a view into the mapping, or *buffer after reading into it
+static const uint8_t *archive_view(archive_reader_t *ar, size_t len, uint8_t **buffer, size_t *capacity)
+{
+    if (ar->map.data)
+    {
+        if (len > ar->map.size - ar->pos)
+        {
+            return NULL;
+        }
+        const uint8_t *view = ar->map.data + ar->pos;
+        ar->pos += len;
+        return view;
+    }
+    if (!ensure_capacity(buffer, capacity, len) || fread(*buffer, 1, len, ar->file) != len)
+    {
+        return NULL;
+    }
+    ar->pos += len;
+    return *buffer;
+}
+
+// Positions the reader at an absolute offset; needs a seekable archive
+static int archive_seek(archive_reader_t *ar, uint64_t offset)
+{
+    if (ar->map.data)
+    {
+        if (offset > ar->map.size)
+        {
+            return 0;
+        }
+        ar->pos = (size_t)offset;
+        ar->released = ar->pos < ar->released ? ar->pos : ar->released;
+        return 1;
+    }
+    if (fseeko(ar->file, (off_t)offset, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+    ar->pos = (size_t)offset;
+    return 1;
+}
+
+// Hands back the pages of everything consumed so far
+static void archive_release(archive_reader_t *ar)
+{
+    if (ar->pos > ar->released)
+    {
+        io_map_release(&ar->map, ar->released, ar->pos - ar->released);
+        ar->released = ar->pos;
+    }
+}
+
+// Opens and maps the archive; "-" reads stdin
+static fm_status_t open_archive_in(archive_reader_t *ar, const char *input_path)
+{
+    memset(ar, 0, sizeof(*ar));
+    ar->file = strcmp(input_path, "-") == 0 ? stdin : fopen(input_path, "rb");
+    if (!ar->file)
+    {
+        return FM_STATUS_FILE_NOT_FOUND;
+    }
+    if (io_map_fd(fileno(ar->file), &ar->map) != 0)
+    {
+        ar->map.data = NULL; // not mappable: fall back to buffered reads
+    }
+    return FM_STATUS_OK;
+}
+
+static void close_archive_in(archive_reader_t *ar)
+{
+    io_unmap(&ar->map);
+    if (ar->file && ar->file != stdin)
+    {
+        fclose(ar->file);
+    }
+    ar->file = NULL;
+}
+
+// Checks the magic number and format version at the current position
+static fm_status_t check_signature(archive_reader_t *ar)
+{
+    char magic[FM_MAGIC_SIZE];
+    uint32_t version = 0;
+    if (archive_read(ar, magic, FM_MAGIC_SIZE) != FM_MAGIC_SIZE ||
+        archive_read(ar, &version, sizeof(version)) != sizeof(version))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    if (memcmp(magic, FM_MAGIC, FM_MAGIC_SIZE) != 0 || version != FM_FORMAT_VERSION)
+    {
+        return FM_STATUS_ERROR;
+    }
+    return FM_STATUS_OK;
+}
+
+// Reverses the block's recorded pipeline and verifies the result
+static void decode_block(decode_job_t *job, bwt_context_t *worker, int threads, const fm_stats_t *stats)
+{
+    if (stats)
+    {
+        memset(&job->stats, 0, sizeof(job->stats));
+    }
+    bwt_config_t bwt;
+    bwt_config_init(&bwt);
+    bwt.threads = threads;
+    bwt.inverse_memory = job->inverse_memory;
+    pipeline_status_t status = pipeline_decode(&bwt, worker, &job->block, job->payload, (size_t)job->compressed_len,
+                                               job->output, (size_t)job->block_len, job->scratch,
+                                               stats ? &job->stats : NULL);
+    job->status = status == PIPELINE_STATUS_OK ? FM_STATUS_OK : FM_STATUS_ERROR;
+    if (job->status == FM_STATUS_OK && crc32c_update(0, job->output, (size_t)job->block_len) != job->checksum)
+    {
+        job->status = FM_STATUS_ERROR;
+    }
+}
+
+// Reads the next block record of the current entry into 'job'; block_len 0 ends the entry
+static fm_status_t read_block_record(archive_reader_t *ar, decode_job_t *job)
+{
+    if (!archive_read_u64(ar, &job->block_len))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    if (job->block_len == 0)
+    {
+        return FM_STATUS_OK;
+    }
+
+    uint64_t stages = 0;
+    uint64_t chain_count = 0;
+    uint64_t chain_index[BWT_MAX_CHAINS];
+    if (!archive_read_u64(ar, &stages) || !archive_read_u64(ar, &chain_count))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    if (job->block_len > SIZE_MAX / 2 || (stages & ~(uint64_t)PIPELINE_STAGE_MASK) ||
+        chain_count > BWT_MAX_CHAINS)
+    {
+        return FM_STATUS_ERROR;
+    }
+    size_t index_bytes = (size_t)chain_count * sizeof(chain_index[0]);
+    if (archive_read(ar, chain_index, index_bytes) != index_bytes || !archive_read_u64(ar, &job->checksum) ||
+        !archive_read_u64(ar, &job->compressed_len))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    job->block.stages = (uint32_t)stages;
+    job->block.chain_count = (size_t)chain_count;
+    for (uint64_t c = 0; c < chain_count; c++)
+    {
+        job->block.chain_index[c] = (size_t)chain_index[c];
+    }
+
+    size_t work_size = pipeline_max_encoded_size(job->block.stages, (size_t)job->block_len);
+    if (job->compressed_len > work_size)
+    {
+        return FM_STATUS_ERROR;
+    }
+    if (!ensure_capacity(&job->scratch, &job->scratch_cap, work_size) ||
+        !ensure_capacity(&job->output, &job->output_cap, work_size))
+    {
+        return FM_STATUS_ALLOCATION_FAILURE;
+    }
+    job->slice_offset = 0;
+    job->slice_len = job->block_len;
+    job->payload = archive_view(ar, (size_t)job->compressed_len, &job->compressed, &job->compressed_cap);
+    return job->payload ? FM_STATUS_OK : FM_STATUS_IO_ERROR;
+}
+
+// Reads a length-prefixed entry name into a new string
+static fm_status_t read_entry_name(archive_reader_t *ar, char **name)
+{
+    uint64_t name_len = 0;
+    if (!archive_read_u64(ar, &name_len))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    if (name_len >= MAX_PATH)
+    {
+        return FM_STATUS_ERROR;
+    }
+    *name = (char *)malloc(name_len + 1);
+    if (!*name)
+    {
+        return FM_STATUS_ALLOCATION_FAILURE;
+    }
+    if (archive_read(ar, *name, (size_t)name_len) != name_len)
+    {
+        free(*name);
+        *name = NULL;
+        return FM_STATUS_IO_ERROR;
+    }
+    (*name)[name_len] = '\0';
+    return FM_STATUS_OK;
+}
+
+// Drops the names a solid or link record left in 'job'
+static void clear_record(decode_job_t *job)
+{
+    for (size_t m = 0; m < job->member_count; m++)
+    {
+        free(job->members[m].name);
+    }
+    job->member_count = 0;
+    free(job->link_name);
+    free(job->link_target);
+    job->link_name = NULL;
+    job->link_target = NULL;
+}
+
+// Reads a solid record's member list and its block into 'job'
+static fm_status_t read_solid_record(archive_reader_t *ar, decode_job_t *job)
+{
+    uint64_t count = 0;
+    if (!archive_read_u64(ar, &count))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    if (count == 0 || count > FM_SOLID_MAX_MEMBERS)
+    {
+        return FM_STATUS_ERROR;
+    }
+    if (count > job->member_cap)
+    {
+        solid_member_t *members = (solid_member_t *)realloc(job->members, (size_t)count * sizeof(solid_member_t));
+        if (!members)
+        {
+            return FM_STATUS_ALLOCATION_FAILURE;
+        }
+        job->members = members;
+        job->member_cap = (size_t)count;
+    }
+
+    uint64_t total = 0;
+    while (job->member_count < count)
+    {
+        solid_member_t *member = &job->members[job->member_count];
+        fm_status_t status = read_entry_name(ar, &member->name);
+        if (status != FM_STATUS_OK)
+        {
+            return status;
+        }
+        job->member_count++;
+        if (!archive_read_u64(ar, &member->size))
+        {
+            return FM_STATUS_IO_ERROR;
+        }
+        total += member->size;
+        if (total < member->size)
+        {
+            return FM_STATUS_ERROR;
+        }
+    }
+
+    fm_status_t status = read_block_record(ar, job);
+    if (status == FM_STATUS_OK && (total == 0 || job->block_len != total))
+    {
+        status = FM_STATUS_ERROR;
+    }
+    return status;
+}
+
+// Creates output_path/name and any missing parent directories
+static int create_entry_file(const char *output_path, const char *name)
+{
+    char full_output_path[MAX_PATH];
+    snprintf(full_output_path, sizeof(full_output_path), "%s/%s", output_path, name);
+    create_directories(full_output_path);
+    return open(full_output_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+}
+
+/*
+  Reads the next record header. An entry record gets its output file
+  created in *fd; a solid or link record is read whole into 'job'. *fd is
+  -1 and 'job' holds no record once the directory is reached.
+*/
+static fm_status_t open_next_entry(archive_reader_t *ar, const char *output_path, int *fd, decode_job_t *job)
 {
-    if (!in || !out || !filename)
+    *fd = -1;
+    clear_record(job);
+
+    uint64_t type = 0;
+    if (!archive_read_u64(ar, &type))
     {
-        return FM_STATUS_INVALID_ARGUMENT;
+        return FM_STATUS_IO_ERROR; // truncated: archives always end with a directory
     }
-
-    // Read entire file and append a single '$' sentinel byte so BWT has a unique terminator.
-    fseek(in, 0, SEEK_END);
-    long file_size = ftell(in);
-    fseek(in, 0, SEEK_SET);
-
-    if (file_size < 0)
+    if (type == FM_RECORD_DIRECTORY)
     {
-        return FM_STATUS_IO_ERROR;
+        return FM_STATUS_OK;
+    }
+    if (type == FM_RECORD_SOLID)
+    {
+        return read_solid_record(ar, job);
+    }
+    if (type == FM_RECORD_LINK)
+    {
+        fm_status_t status = read_entry_name(ar, &job->link_name);
+        if (status == FM_STATUS_OK)
+        {
+            status = read_entry_name(ar, &job->link_target);
+        }
+        job->status = status;
+        return status;
+    }
+    if (type != FM_RECORD_ENTRY)
+    {
+        return FM_STATUS_ERROR;
     }
 
-    // Allocate input/output buffers for file_size + 1 to accommodate the sentinel
-    size_t with_sentinel = (size_t)file_size + 1;
-    uint8_t *input = (uint8_t *)malloc(with_sentinel);
-    uint8_t *output = (uint8_t *)malloc(with_sentinel);
-    if (!input || !output)
+    char *filename = NULL;
+    fm_status_t status = read_entry_name(ar, &filename);
+    if (status != FM_STATUS_OK)
     {
-        free(input);
-        free(output);
-        return FM_STATUS_ALLOCATION_FAILURE;
+        return status;
     }
+    *fd = create_entry_file(output_path, filename);
+    free(filename);
+    return *fd >= 0 ? FM_STATUS_OK : FM_STATUS_IO_ERROR;
+}
 
-    if (file_size > 0)
+// Writes each member of a decoded solid block to its own file under output_path
+static fm_status_t write_solid_members(const decode_job_t *job, const char *output_path)
+{
+    const uint8_t *data = job->output;
+    for (size_t m = 0; m < job->member_count; m++)
     {
-        if (fread(input, 1, (size_t)file_size, in) != (size_t)file_size)
+        const solid_member_t *member = &job->members[m];
+        int fd = create_entry_file(output_path, member->name);
+        if (fd < 0)
+        {
+            return FM_STATUS_IO_ERROR;
+        }
+        int failed = io_pwrite_all(fd, data, (size_t)member->size, 0) != 0;
+        if (close(fd) != 0 || failed)
         {
-            free(input);
-            free(output);
             return FM_STATUS_IO_ERROR;
         }
+        data += member->size;
     }
+    return FM_STATUS_OK;
+}
 
-    // Append sentinel '$' at the end
-    input[with_sentinel - 1] = (uint8_t)'$';
-
-    size_t primary_index = 0;
-    bwt_status_t bwt_status = bwt_forward((const uint8_t *)input, with_sentinel, output, &primary_index);
-    if (bwt_status != BWT_STATUS_OK)
+// Recreates a link as a copy of its target, which earlier jobs already wrote and closed
+static fm_status_t write_link(const decode_job_t *job, const char *output_path)
+{
+    char target_path[MAX_PATH];
+    snprintf(target_path, sizeof(target_path), "%s/%s", output_path, job->link_target);
+    int src = open(target_path, O_RDONLY);
+    if (src < 0)
     {
-        free(input);
-        free(output);
-        return FM_STATUS_ERROR;
+        return FM_STATUS_ERROR; // the target must precede the link in the archive
+    }
+    int dst = create_entry_file(output_path, job->link_name);
+    int failed = dst < 0 || io_copy_file(dst, src) != 0;
+    if (dst >= 0 && close(dst) != 0)
+    {
+        failed = 1;
     }
+    close(src);
+    return failed ? FM_STATUS_IO_ERROR : FM_STATUS_OK;
+}
+
+// Memory left to the blocks of one decode batch
+typedef struct
+{
+    uint64_t usable; // FM_MEMORY_UNLIMITED when the call has no limit
+    uint64_t used;
+} decode_budget_t;
 
-    // Allocate worst-case size: RLE can expand to 2x if no runs exist
-    size_t max_rled_size = with_sentinel * 2;
-    uint8_t *rled_output = (uint8_t *)malloc(max_rled_size);
-    if (!rled_output)
+/*
+  Charges a queued block to its batch: its buffers plus the inverse BWT
+  table. A block that does not fit in what is left keeps its buffers but
+  gets a capped, slower inverse sized to the remainder. Returns 0 once no
+  further block of the same size would fit, which closes the batch.
+*/
+static int admit_decode_job(decode_budget_t *budget, decode_job_t *job)
+{
+    job->inverse_memory = 0;
+    if (budget->usable == FM_MEMORY_UNLIMITED || job->link_name)
     {
-        free(input);
-        free(output);
-        return FM_STATUS_ALLOCATION_FAILURE;
+        return 1;
     }
-    size_t rled_size = max_rled_size;
-    rle_encode(output, with_sentinel, rled_output, &rled_size);
-    // rled_size now contains the actual compressed size
-
-    uint64_t filename_len = strlen(filename);
-    // Store data_len as original_size + 1 to include the sentinel in the compressed container
-    uint64_t data_len = (uint64_t)with_sentinel;
-    uint64_t prim_idx = (uint64_t)primary_index;
-    uint64_t compressed_len = (uint64_t)rled_size;
-
-    if (fwrite(&filename_len, sizeof(filename_len), 1, out) != 1 ||
-        fwrite(filename, 1, filename_len, out) != filename_len ||
-        fwrite(&data_len, sizeof(data_len), 1, out) != 1 ||
-        fwrite(&prim_idx, sizeof(prim_idx), 1, out) != 1 ||
-        fwrite(&compressed_len, sizeof(compressed_len), 1, out) != 1 ||
-        fwrite(rled_output, 1, rled_size, out) != rled_size)
-    {
-        free(input);
-        free(output);
-        free(rled_output);
-        return FM_STATUS_IO_ERROR;
+    uint64_t buffers = job->scratch_cap + job->output_cap + (job->payload == job->compressed ? job->compressed_cap : 0);
+    uint64_t table = (job->block.stages & PIPELINE_STAGE_BWT) ? bwt_inverse_workspace_bytes(NULL, (size_t)job->block_len) : 0;
+    uint64_t left = budget->usable - budget->used;
+    if (buffers + table <= left)
+    {
+        budget->used += buffers + table;
+        return budget->usable - budget->used >= buffers + table;
     }
-
-    free(input);
-    free(output);
-    free(rled_output);
-    return FM_STATUS_OK;
+    job->inverse_memory = left > buffers ? (size_t)(left - buffers) : 1;
+    budget->used = budget->usable;
+    return 0;
 }
 
-// Recursively processes a directory
-static fm_status_t compress_directory_recursive(const char *dir_path, FILE *out, const char *base_path)
+// Decodes a batch of queued blocks in parallel, then writes them in archive order.
+// On failure the remaining blocks are skipped but their files are still closed.
+static fm_status_t flush_decode_batch(decode_job_t *jobs, int filled, int batch, bwt_context_t *workers,
+                                      const char *output_path, fm_stats_t *stats, fm_status_t status)
 {
-    DIR *dir = opendir(dir_path);
-    if (!dir)
+    if (status == FM_STATUS_OK)
     {
-        return FM_STATUS_FILE_NOT_FOUND;
+        thread_split_t split = split_threads(batch, filled);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(split.workers) if (split.workers > 1)
+        for (int i = 0; i < filled; i++)
+        {
+            if (!jobs[i].link_name)
+            {
+                decode_block(&jobs[i], &workers[omp_get_thread_num()], split.inner, stats);
+            }
+        }
     }
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL)
+    double started = stats ? omp_get_wtime() : 0;
+    for (int i = 0; i < filled; i++)
     {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        decode_job_t *job = &jobs[i];
+        if (status == FM_STATUS_OK)
         {
-            continue;
+            status = job->status;
         }
-
-        char full_path[MAX_PATH];
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
-
-        struct stat statbuf;
-        if (stat(full_path, &statbuf) != 0)
+        if (stats && status == FM_STATUS_OK && !job->link_name)
         {
-            continue;
+            stats_add_block(stats, &job->stats, job->block.stages, job->block_len);
         }
-
-        if (S_ISDIR(statbuf.st_mode))
+        if (status == FM_STATUS_OK && job->link_name)
         {
-            // Recursively process subdirectory
-            fm_status_t status = compress_directory_recursive(full_path, out, base_path);
-            if (status != FM_STATUS_OK)
-            {
-                closedir(dir);
-                return status;
-            }
+            status = write_link(job, output_path);
         }
-        else if (S_ISREG(statbuf.st_mode))
+        else if (status == FM_STATUS_OK && job->member_count > 0)
         {
-            // Compress file with relative path
-            FILE *in = fopen(full_path, "rb");
-            if (!in)
-            {
-                continue;
-            }
-
-            // Calculate relative path
-            char relative_path[MAX_PATH];
-            if (strlen(full_path) > strlen(base_path) + 1)
-            {
-                strcpy(relative_path, full_path + strlen(base_path) + 1);
-            }
-            else
-            {
-                strcpy(relative_path, entry->d_name);
-            }
-
-            fm_status_t status = compress_single_file(in, out, relative_path);
-            fclose(in);
-            if (status != FM_STATUS_OK)
+            status = write_solid_members(job, output_path);
+        }
+        else if (status == FM_STATUS_OK)
+        {
+            const uint8_t *slice = job->output + job->slice_offset;
+            int failed = job->sequential
+                             ? fwrite(slice, 1, (size_t)job->slice_len, stdout) != job->slice_len
+                             : io_pwrite_all(job->fd, slice, (size_t)job->slice_len, job->offset) != 0;
+            if (failed)
             {
-                closedir(dir);
-                return status;
+                status = FM_STATUS_IO_ERROR;
             }
         }
+        if (job->last_in_entry && close(job->fd) != 0 && status == FM_STATUS_OK)
+        {
+            status = FM_STATUS_IO_ERROR;
+        }
+    }
+    if (stats)
+    {
+        stats->write_seconds += omp_get_wtime() - started;
     }
+    return status;
+}
 
-    closedir(dir);
-    return FM_STATUS_OK;
+// Decompress .w file
+fm_status_t fm_decompress(const char *input_path, const char *output_path)
+{
+    return fm_decompress_ex(input_path, output_path, NULL);
 }
 
-fm_status_t fm_compress(const char *input_path, const char *output_path)
+/*
+  Blocks are read in batches of one per worker, possibly spanning several
+  entries, or fewer once the blocks read fill the memory limit. Each batch
+  is decoded in parallel and then written in archive order, so only one
+  batch of blocks is ever held in memory.
+*/
+fm_status_t fm_decompress_ex(const char *input_path, const char *output_path, const fm_config_t *cfg)
 {
     if (!input_path || !output_path)
     {
         return FM_STATUS_INVALID_ARGUMENT;
     }
 
-    FILE *out = fopen(output_path, "wb");
-    if (!out)
+    fm_config_t local_cfg;
+    if (!cfg)
     {
-        return FM_STATUS_IO_ERROR;
+        fm_config_init(&local_cfg);
+        cfg = &local_cfg;
     }
+    fm_config_t planned;
+    cfg = plan_memory(cfg, &planned);
 
-    fm_path_type_t path_type = fm_get_path_type(input_path);
-    fm_status_t status = FM_STATUS_OK;
+    // "-" reads the archive from stdin; sequential extraction never needs to seek
+    archive_reader_t ar;
+    fm_status_t status = open_archive_in(&ar, input_path);
+    if (status != FM_STATUS_OK)
+    {
+        return status;
+    }
+    status = check_signature(&ar);
+
+    int batch = block_parallelism(cfg);
+    fm_context_t local_ctx;
+    fm_context_t *ctx = acquire_context(cfg, &local_ctx);
+    stats_begin(cfg->stats, cfg, ctx);
+    bwt_context_t *workers = context_workers(ctx, batch);
+    decode_job_t *jobs = workers ? context_decode_jobs(ctx, batch) : NULL;
+    if (!jobs)
+    {
+        release_context(ctx, &local_ctx);
+        close_archive_in(&ar);
+        return FM_STATUS_ALLOCATION_FAILURE;
+    }
 
-    if (path_type == FM_TYPE_FILE)
+    // Create base output directory if it does not exist
+    mkdir(output_path, 0755);
+
+    int current_fd = -1; // entry whose blocks are still being queued
+    uint64_t current_offset = 0;
+    int at_end = 0;
+
+    while (status == FM_STATUS_OK && !at_end)
     {
-        FILE *in = fopen(input_path, "rb");
-        if (!in)
+        int filled = 0;
+        decode_budget_t budget = {usable_memory(cfg->memory_limit), 0};
+        double started = cfg->stats ? omp_get_wtime() : 0;
+        while (filled < batch && status == FM_STATUS_OK)
         {
-            fclose(out);
-            return FM_STATUS_FILE_NOT_FOUND;
+            decode_job_t *job = &jobs[filled];
+            if (current_fd < 0)
+            {
+                status = open_next_entry(&ar, output_path, &current_fd, job);
+                current_offset = 0;
+                if (cfg->stats && status == FM_STATUS_OK)
+                {
+                    cfg->stats->files += job->member_count > 0 ? job->member_count : (job->link_name || current_fd >= 0);
+                }
+                if (status == FM_STATUS_OK && (job->member_count > 0 || job->link_name))
+                {
+                    // Solid blocks and links are complete on their own and write their files themselves
+                    job->fd = -1;
+                    job->last_in_entry = 0;
+                    if (!admit_decode_job(&budget, &jobs[filled++]))
+                    {
+                        break;
+                    }
+                    continue;
+                }
+                if (status != FM_STATUS_OK || current_fd < 0)
+                {
+                    at_end = 1;
+                    break;
+                }
+            }
+
+            clear_record(job);
+            status = read_block_record(&ar, job);
+            if (status != FM_STATUS_OK)
+            {
+                break;
+            }
+            if (job->block_len == 0)
+            {
+                // End of entry: the writer of its last queued block closes the file,
+                // or it is closed here when earlier batches already wrote every block
+                if (filled > 0 && jobs[filled - 1].fd == current_fd)
+                {
+                    jobs[filled - 1].last_in_entry = 1;
+                }
+                else if (close(current_fd) != 0)
+                {
+                    status = FM_STATUS_IO_ERROR;
+                }
+                current_fd = -1;
+                continue;
+            }
+            job->fd = current_fd;
+            job->offset = current_offset;
+            job->sequential = 0;
+            job->last_in_entry = 0;
+            current_offset += job->block_len;
+            if (!admit_decode_job(&budget, &jobs[filled++]))
+            {
+                break;
+            }
+        }
+
+        if (cfg->stats)
+        {
+            cfg->stats->read_seconds += omp_get_wtime() - started;
         }
-        char *filename = basename((char *)input_path);
-        status = compress_single_file(in, out, filename);
-        fclose(in);
+        status = flush_decode_batch(jobs, filled, batch, workers, output_path, cfg->stats, status);
+        archive_release(&ar);
     }
-    else
+
+    if (current_fd >= 0)
     {
-        status = compress_directory_recursive(input_path, out, input_path);
+        close(current_fd);
     }
-
-    fclose(out);
+    stats_finish(cfg->stats, ctx, ar.pos);
+    release_context(ctx, &local_ctx);
+    close_archive_in(&ar);
     return status;
 }
 
-// Create necessary directories
-static fm_status_t create_directories(const char *filepath)
+// Strips "./" prefixes so "./conf/app.ini" finds the entry "conf/app.ini"
+static const char *normalize_entry_path(const char *path)
 {
-    if (!filepath || filepath[0] == '\0')
+    while (path[0] == '.' && path[1] == '/')
     {
-        return FM_STATUS_OK;
+        path += 2;
     }
+    return path;
+}
 
-    char *path = (char *)malloc(strlen(filepath) + 1);
-    if (!path)
+/*
+  Finds entry_path in the central directory, fills 'found' except for its
+  name and blocks, and leaves the reader on its block table. Returns
+  FM_STATUS_FILE_NOT_FOUND when the archive has no such entry.
+*/
+static fm_status_t find_directory_entry(archive_reader_t *ar, const char *entry_path, dir_entry_t *found)
+{
+    struct stat statbuf;
+    uint64_t archive_size = ar->map.data ? ar->map.size
+                                         : (fstat(fileno(ar->file), &statbuf) == 0 ? (uint64_t)statbuf.st_size : 0);
+    if (archive_size < FM_MAGIC_SIZE + sizeof(uint32_t) + FM_FOOTER_SIZE)
     {
-        return FM_STATUS_ALLOCATION_FAILURE;
+        return FM_STATUS_ERROR;
     }
 
-    strcpy(path, filepath);
-    char *dir = dirname(path);
-
-    // Create directories recursively
-    char temp[MAX_PATH];
-    strcpy(temp, dir);
-
-    for (size_t i = 1; i < strlen(temp); i++)
+    uint64_t directory_offset = 0;
+    uint64_t directory_checksum = 0;
+    uint64_t footer_offset = archive_size - FM_FOOTER_SIZE;
+    if (!archive_seek(ar, footer_offset) || !archive_read_u64(ar, &directory_offset) ||
+        !archive_read_u64(ar, &directory_checksum))
     {
-        if (temp[i] == '/')
-        {
-            temp[i] = '\0';
-            mkdir(temp, 0755);
-            temp[i] = '/';
-        }
+        return FM_STATUS_IO_ERROR;
     }
-    mkdir(temp, 0755);
-
-    free(path);
-    return FM_STATUS_OK;
-}
-
-// Decompress .w file
-fm_status_t fm_decompress(const char *input_path, const char *output_path)
-{
-    if (!input_path || !output_path)
+    fm_status_t status = check_signature(ar);
+    if (status != FM_STATUS_OK)
     {
-        return FM_STATUS_INVALID_ARGUMENT;
+        return status;
     }
-
-    FILE *in = fopen(input_path, "rb");
-    if (!in)
+    if (directory_offset >= footer_offset)
     {
-        return FM_STATUS_FILE_NOT_FOUND;
+        return FM_STATUS_ERROR;
     }
 
-    fm_status_t status = FM_STATUS_OK;
+    // Verify the whole directory before trusting any offset in it
+    size_t directory_len = (size_t)(footer_offset - directory_offset);
+    uint8_t *copy = NULL;
+    size_t copy_cap = 0;
+    const uint8_t *directory = NULL;
+    if (archive_seek(ar, directory_offset))
+    {
+        directory = archive_view(ar, directory_len, &copy, &copy_cap);
+    }
+    int intact = directory && crc32c_update(0, directory, directory_len) == directory_checksum;
+    free(copy);
+    if (!intact)
+    {
+        return directory ? FM_STATUS_ERROR : FM_STATUS_IO_ERROR;
+    }
 
-    // Create base output directory if it does not exist
-    mkdir(output_path, 0755);
+    uint64_t type = 0;
+    uint64_t entry_count = 0;
+    if (!archive_seek(ar, directory_offset) || !archive_read_u64(ar, &type) || !archive_read_u64(ar, &entry_count))
+    {
+        return FM_STATUS_IO_ERROR;
+    }
+    if (type != FM_RECORD_DIRECTORY)
+    {
+        return FM_STATUS_ERROR;
+    }
 
-    while (1)
+    const char *wanted = normalize_entry_path(entry_path);
+    for (uint64_t i = 0; i < entry_count; i++)
     {
-        uint64_t filename_len = 0;
-        if (fread(&filename_len, sizeof(filename_len), 1, in) != 1)
+        char *name = NULL;
+        uint64_t block_count = 0;
+        if (!archive_read_u64(ar, &found->kind))
         {
-            printf("aqui 1\n");
-            if (feof(in))
-                break;
-            status = FM_STATUS_IO_ERROR;
-            break;
+            return FM_STATUS_IO_ERROR;
         }
-
-        char *filename = (char *)malloc(filename_len + 1);
-        if (!filename)
+        status = read_entry_name(ar, &name);
+        if (status != FM_STATUS_OK)
         {
-            status = FM_STATUS_ALLOCATION_FAILURE;
-            break;
+            return status;
         }
-
-        if (fread(filename, 1, filename_len, in) != filename_len)
+        int match = strcmp(name, wanted) == 0;
+        free(name);
+        if (!archive_read_u64(ar, &found->offset) || !archive_read_u64(ar, &found->original_size) ||
+            !archive_read_u64(ar, &found->solid_offset) || !archive_read_u64(ar, &block_count))
         {
-            free(filename);
-            status = FM_STATUS_IO_ERROR;
-            printf("aqui 2\n");
-            break;
+            return FM_STATUS_IO_ERROR;
         }
-        filename[filename_len] = '\0';
-
-        uint64_t data_len = 0;
-        uint64_t primary_index = 0;
-        uint64_t compressed_len = 0;
-        if (fread(&data_len, sizeof(data_len), 1, in) != 1 ||
-            fread(&primary_index, sizeof(primary_index), 1, in) != 1 ||
-            fread(&compressed_len, sizeof(compressed_len), 1, in) != 1)
+        if (block_count > footer_offset)
         {
-            free(filename);
-            status = FM_STATUS_IO_ERROR;
-            printf("aqui 3\n");
-            break;
+            return FM_STATUS_ERROR;
         }
-
-        // Allocate buffer for compressed (RLE) data
-        uint8_t *compressed_data = (uint8_t *)malloc(compressed_len);
-        // Allocate buffer for decompressed (BWT) data
-        uint8_t *bwt_data = (uint8_t *)malloc(data_len);
-        // Allocate buffer for final output data
-        uint8_t *output_data = (uint8_t *)malloc(data_len);
-
-        if (!compressed_data || !bwt_data || !output_data)
+        found->block_count = (size_t)block_count;
+        if (match)
         {
-            free(filename);
-            free(compressed_data);
-            free(bwt_data);
-            free(output_data);
-            status = FM_STATUS_ALLOCATION_FAILURE;
-            break;
+            return FM_STATUS_OK;
         }
 
-        // Read the compressed (RLE) data
-        if (fread(compressed_data, 1, compressed_len, in) != compressed_len)
+        // Skip this entry's block table
+        uint64_t table_bytes = block_count * 3 * sizeof(uint64_t);
+        uint64_t next = (ar->map.data ? ar->pos : (uint64_t)ftello(ar->file)) + table_bytes;
+        if (next > footer_offset || !archive_seek(ar, next))
         {
-            free(filename);
-            free(compressed_data);
-            free(bwt_data);
-            free(output_data);
-            status = FM_STATUS_IO_ERROR;
-            printf("aqui 4\n");
-            printf("compressed_len: %lu\n", compressed_len);
-            break;
+            return FM_STATUS_ERROR;
         }
+    }
+    return FM_STATUS_FILE_NOT_FOUND;
+}
+
+/*
+  Extracts a single entry using the central directory: only the entry's
+  own block records are read and decoded, however large the archive.
+*/
+fm_status_t fm_extract_one(const char *archive_path, const char *entry_path, const char *output_path,
+                           const fm_config_t *cfg)
+{
+    if (!archive_path || !entry_path || !output_path)
+    {
+        return FM_STATUS_INVALID_ARGUMENT;
+    }
+
+    fm_config_t local_cfg;
+    if (!cfg)
+    {
+        fm_config_init(&local_cfg);
+        cfg = &local_cfg;
+    }
+    fm_config_t planned;
+    cfg = plan_memory(cfg, &planned);
+
+    archive_reader_t ar;
+    fm_status_t status = open_archive_in(&ar, archive_path);
+    if (status != FM_STATUS_OK)
+    {
+        return status;
+    }
+    if (ar.file == stdin)
+    {
+        close_archive_in(&ar);
+        return FM_STATUS_INVALID_ARGUMENT; // random access needs a seekable archive
+    }
 
-        // First, decode RLE to get BWT data
-        size_t bwt_size = data_len;
-        rle_decode(compressed_data, compressed_len, bwt_data, &bwt_size);
+    dir_entry_t found;
+    memset(&found, 0, sizeof(found));
+    status = find_directory_entry(&ar, entry_path, &found);
+    if (status != FM_STATUS_OK)
+    {
+        close_archive_in(&ar);
+        return status;
+    }
+    uint64_t block_count = found.block_count;
+    if (found.kind == FM_RECORD_SOLID && block_count != 1)
+    {
+        close_archive_in(&ar);
+        return FM_STATUS_ERROR;
+    }
 
-        if (bwt_size != data_len)
+    // The block table is read up front so the reader is free to jump between records
+    dir_block_t *table = (dir_block_t *)malloc((size_t)(block_count ? block_count : 1) * sizeof(dir_block_t));
+    if (!table)
+    {
+        close_archive_in(&ar);
+        return FM_STATUS_ALLOCATION_FAILURE;
+    }
+    for (uint64_t b = 0; b < block_count && status == FM_STATUS_OK; b++)
+    {
+        if (!archive_read_u64(&ar, &table[b].offset) || !archive_read_u64(&ar, &table[b].length) ||
+            !archive_read_u64(&ar, &table[b].checksum))
         {
-            free(filename);
-            free(compressed_data);
-            free(bwt_data);
-            free(output_data);
-            status = FM_STATUS_ERROR;
-            break;
+            status = FM_STATUS_IO_ERROR;
         }
+    }
 
-        // Then, reverse BWT to get original data
-        bwt_status_t bwt_status = bwt_inverse(bwt_data, bwt_size, (size_t)primary_index, output_data);
-        if (bwt_status != BWT_STATUS_OK)
+    int to_stdout = strcmp(output_path, "-") == 0;
+    int fd = -1;
+    if (status == FM_STATUS_OK)
+    {
+        if (to_stdout)
         {
-            free(filename);
-            free(compressed_data);
-            free(bwt_data);
-            free(output_data);
-            status = FM_STATUS_ERROR;
-            break;
+            fd = STDOUT_FILENO;
         }
+        else
+        {
+            mkdir(output_path, 0755);
+            fd = create_entry_file(output_path, normalize_entry_path(entry_path));
+            status = fd >= 0 ? FM_STATUS_OK : FM_STATUS_IO_ERROR;
+        }
+    }
 
-        // Construct full path
-        char full_output_path[MAX_PATH];
-        snprintf(full_output_path, sizeof(full_output_path), "%s/%s", output_path, filename);
-
-        // Create necessary directories
-        create_directories(full_output_path);
+    int batch = block_parallelism(cfg);
+    fm_context_t local_ctx;
+    fm_context_t *ctx = acquire_context(cfg, &local_ctx);
+    stats_begin(cfg->stats, cfg, ctx);
+    bwt_context_t *workers = context_workers(ctx, batch);
+    decode_job_t *jobs = workers ? context_decode_jobs(ctx, batch) : NULL;
+    if (!jobs)
+    {
+        status = FM_STATUS_ALLOCATION_FAILURE;
+    }
 
-        // Write file
-        FILE *out = fopen(full_output_path, "wb");
-        if (!out)
+    uint64_t next_block = 0;
+    uint64_t offset = 0;
+    uint64_t record_bytes = 0; // archive bytes read for the entry's blocks
+    while (status == FM_STATUS_OK && next_block < block_count)
+    {
+        int filled = 0;
+        decode_budget_t budget = {usable_memory(cfg->memory_limit), 0};
+        double started = cfg->stats ? omp_get_wtime() : 0;
+        while (filled < batch && next_block < block_count && status == FM_STATUS_OK)
         {
-            free(filename);
-            free(compressed_data);
-            free(bwt_data);
-            free(output_data);
-            status = FM_STATUS_IO_ERROR;
-            printf("aqui 5\n");
-            break;
+            const dir_block_t *entry_block = &table[next_block++];
+            decode_job_t *job = &jobs[filled];
+            if (!archive_seek(&ar, entry_block->offset))
+            {
+                status = FM_STATUS_IO_ERROR;
+                break;
+            }
+            size_t record_start = ar.pos;
+            status = read_block_record(&ar, job);
+            record_bytes += ar.pos - record_start;
+            if (status == FM_STATUS_OK &&
+                (job->block_len != entry_block->length || job->checksum != entry_block->checksum))
+            {
+                status = FM_STATUS_ERROR;
+            }
+            if (status == FM_STATUS_OK && found.kind == FM_RECORD_SOLID)
+            {
+                // Only the member's own bytes of the shared block are written
+                if (found.solid_offset > job->block_len || found.original_size > job->block_len - found.solid_offset)
+                {
+                    status = FM_STATUS_ERROR;
+                }
+                job->slice_offset = found.solid_offset;
+                job->slice_len = found.original_size;
+            }
+            if (status != FM_STATUS_OK)
+            {
+                break;
+            }
+            job->fd = fd;
+            job->offset = offset;
+            job->sequential = to_stdout;
+            job->last_in_entry = 0;
+            offset += job->slice_len;
+            if (!admit_decode_job(&budget, &jobs[filled++]))
+            {
+                break;
+            }
         }
-
-        // If we appended a sentinel during compression, strip the trailing '$' when writing
-        // so the decompressed file matches the original.
-        size_t write_len = (size_t)data_len;
-        if (write_len > 0 && output_data[write_len - 1] == (uint8_t)'$')
+        if (cfg->stats)
         {
-            write_len -= 1; // remove sentinel from output
+            cfg->stats->read_seconds += omp_get_wtime() - started;
         }
+        status = flush_decode_batch(jobs, filled, batch, workers, output_path, cfg->stats, status);
+    }
 
-        if (fwrite(output_data, 1, write_len, out) != write_len)
+    if (to_stdout)
+    {
+        if (fflush(stdout) != 0 && status == FM_STATUS_OK)
         {
-            free(filename);
-            free(compressed_data);
-            free(bwt_data);
-            free(output_data);
-            fclose(out);
             status = FM_STATUS_IO_ERROR;
-            printf("aqui 6\n");
-            break;
         }
-
-        fclose(out);
-        free(filename);
-        free(compressed_data);
-        free(bwt_data);
-        free(output_data);
     }
-
-    fclose(in);
+    else if (fd >= 0 && close(fd) != 0 && status == FM_STATUS_OK)
+    {
+        status = FM_STATUS_IO_ERROR;
+    }
+    if (cfg->stats)
+    {
+        cfg->stats->files = status == FM_STATUS_OK;
+    }
+    stats_finish(cfg->stats, ctx, record_bytes);
+    release_context(ctx, &local_ctx);
+    free(table);
+    close_archive_in(&ar);
     return status;
-}
\ No newline at end of file
+}
@@ -0,0 +1,383 @@
+#include "huffman.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+  Encoded layout:
+    [mode u8][symbol_count u64 little endian]
+    mode 0 (raw):     symbol_count bytes follow verbatim
+    mode 1 (huffman): 128 bytes of 4-bit code lengths (two symbols per byte),
+                      then the LSB-first bitstream of canonical codes
+*/
+#define HUFFMAN_MODE_RAW 0
+#define HUFFMAN_MODE_CODED 1
+#define HUFFMAN_PREFIX 9
+#define HUFFMAN_LENGTHS 128
+#define HUFFMAN_TABLE_SIZE (1u << HUFFMAN_MAX_BITS)
+
+size_t huffman_max_encoded_size(size_t input_size)
+{
+    return HUFFMAN_PREFIX + input_size;
+}
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+// Computes Huffman code lengths for the given frequencies, at most HUFFMAN_MAX_BITS long.
+// Over-long trees are rebuilt from flattened frequencies until they fit.
+static void build_code_lengths(const size_t freq[256], uint8_t lengths[256])
+{
+    size_t weight[512];
+    int parent[512];
+    size_t scaled[256];
+    int used = 0;
+
+    for (int s = 0; s < 256; s++)
+    {
+        scaled[s] = freq[s];
+        used += freq[s] > 0;
+    }
+    memset(lengths, 0, 256);
+    if (used == 0)
+    {
+        return;
+    }
+    if (used == 1)
+    {
+        for (int s = 0; s < 256; s++)
+        {
+            if (freq[s] > 0)
+            {
+                lengths[s] = 1;
+            }
+        }
+        return;
+    }
+
+    while (1)
+    {
+        int alive[512];
+        int nodes = 0;
+        int alive_count = 0;
+        int leaf_node[256];
+
+        for (int s = 0; s < 256; s++)
+        {
+            leaf_node[s] = -1;
+            if (scaled[s] > 0)
+            {
+                weight[nodes] = scaled[s];
+                parent[nodes] = -1;
+                leaf_node[s] = nodes;
+                alive[alive_count++] = nodes++;
+            }
+        }
+
+        // Merge the two lightest live nodes until one root remains
+        while (alive_count > 1)
+        {
+            int a = 0;
+            int b = 1;
+            if (weight[alive[b]] < weight[alive[a]])
+            {
+                a = 1;
+                b = 0;
+            }
+            for (int i = 2; i < alive_count; i++)
+            {
+                if (weight[alive[i]] < weight[alive[a]])
+                {
+                    b = a;
+                    a = i;
+                }
+                else if (weight[alive[i]] < weight[alive[b]])
+                {
+                    b = i;
+                }
+            }
+            weight[nodes] = weight[alive[a]] + weight[alive[b]];
+            parent[nodes] = -1;
+            parent[alive[a]] = nodes;
+            parent[alive[b]] = nodes;
+            int hi = a > b ? a : b;
+            int lo = a > b ? b : a;
+            alive[hi] = alive[--alive_count];
+            alive[lo] = nodes++;
+        }
+
+        int max_len = 0;
+        for (int s = 0; s < 256; s++)
+        {
+            if (leaf_node[s] < 0)
+            {
+                continue;
+            }
+            int len = 0;
+            for (int n = leaf_node[s]; parent[n] >= 0; n = parent[n])
+            {
+                len++;
+            }
+            lengths[s] = (uint8_t)len;
+            if (len > max_len)
+            {
+                max_len = len;
+            }
+        }
+        if (max_len <= HUFFMAN_MAX_BITS)
+        {
+            return;
+        }
+        for (int s = 0; s < 256; s++)
+        {
+            if (scaled[s] > 0)
+            {
+                scaled[s] = 1 + scaled[s] / 2;
+            }
+        }
+    }
+}
+
+// Assigns canonical codes (ordered by length, then symbol), bit-reversed for LSB-first output.
+// Returns 0 if the lengths describe a valid prefix code.
+static int assign_codes(const uint8_t lengths[256], uint16_t codes[256])
+{
+    int count[HUFFMAN_MAX_BITS + 1] = {0};
+    uint32_t next[HUFFMAN_MAX_BITS + 2];
+
+    for (int s = 0; s < 256; s++)
+    {
+        if (lengths[s] > HUFFMAN_MAX_BITS)
+        {
+            return -1;
+        }
+        count[lengths[s]]++;
+    }
+    count[0] = 0;
+
+    uint32_t code = 0;
+    for (int len = 1; len <= HUFFMAN_MAX_BITS; len++)
+    {
+        code = (code + (uint32_t)count[len - 1]) << 1;
+        next[len] = code;
+        if (code + (uint32_t)count[len] > (1u << len))
+        {
+            return -1; // over-subscribed
+        }
+    }
+
+    for (int s = 0; s < 256; s++)
+    {
+        int len = lengths[s];
+        if (len == 0)
+        {
+            codes[s] = 0;
+            continue;
+        }
+        uint32_t c = next[len]++;
+        uint16_t reversed = 0;
+        for (int i = 0; i < len; i++)
+        {
+            reversed = (uint16_t)((reversed << 1) | ((c >> i) & 1));
+        }
+        codes[s] = reversed;
+    }
+    return 0;
+}
+
+int huffman_encode(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size)
+{
+    if ((input == NULL && input_size > 0) || output == NULL || output_size == NULL)
+    {
+        return -1;
+    }
+    size_t capacity = *output_size;
+    if (capacity < HUFFMAN_PREFIX)
+    {
+        return -1;
+    }
+
+    size_t freq[256] = {0};
+    for (size_t i = 0; i < input_size; i++)
+    {
+        freq[input[i]]++;
+    }
+
+    uint8_t lengths[256];
+    uint16_t codes[256];
+    build_code_lengths(freq, lengths);
+    assign_codes(lengths, codes);
+
+    size_t total_bits = 0;
+    for (int s = 0; s < 256; s++)
+    {
+        total_bits += freq[s] * lengths[s];
+    }
+    size_t coded_size = HUFFMAN_PREFIX + HUFFMAN_LENGTHS + (total_bits + 7) / 8;
+
+    put_u64(output + 1, (uint64_t)input_size);
+    if (input_size == 0 || coded_size >= HUFFMAN_PREFIX + input_size)
+    {
+        if (capacity < HUFFMAN_PREFIX + input_size)
+        {
+            return -1;
+        }
+        output[0] = HUFFMAN_MODE_RAW;
+        if (input_size > 0)
+        {
+            memcpy(output + HUFFMAN_PREFIX, input, input_size);
+        }
+        *output_size = HUFFMAN_PREFIX + input_size;
+        return 0;
+    }
+    if (capacity < coded_size)
+    {
+        return -1;
+    }
+
+    output[0] = HUFFMAN_MODE_CODED;
+    uint8_t *table = output + HUFFMAN_PREFIX;
+    for (int s = 0; s < 256; s += 2)
+    {
+        table[s / 2] = (uint8_t)(lengths[s] | (lengths[s + 1] << 4));
+    }
+
+    uint8_t *out = table + HUFFMAN_LENGTHS;
+    uint64_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < input_size; i++)
+    {
+        uint8_t s = input[i];
+        acc |= (uint64_t)codes[s] << bits;
+        bits += lengths[s];
+        if (bits >= 32)
+        {
+            out[0] = (uint8_t)acc;
+            out[1] = (uint8_t)(acc >> 8);
+            out[2] = (uint8_t)(acc >> 16);
+            out[3] = (uint8_t)(acc >> 24);
+            out += 4;
+            acc >>= 32;
+            bits -= 32;
+        }
+    }
+    while (bits > 0)
+    {
+        *out++ = (uint8_t)acc;
+        acc >>= 8;
+        bits -= 8;
+    }
+
+    *output_size = (size_t)(out - output);
+    return 0;
+}
+
+int huffman_decode(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size)
+{
+    if (input == NULL || output_size == NULL || input_size < HUFFMAN_PREFIX)
+    {
+        return -1;
+    }
+    uint64_t count = get_u64(input + 1);
+    if (count > *output_size || (count > 0 && output == NULL))
+    {
+        return -1;
+    }
+
+    if (input[0] == HUFFMAN_MODE_RAW)
+    {
+        if (input_size - HUFFMAN_PREFIX != count)
+        {
+            return -1;
+        }
+        if (count > 0)
+        {
+            memcpy(output, input + HUFFMAN_PREFIX, (size_t)count);
+        }
+        *output_size = (size_t)count;
+        return 0;
+    }
+    if (input[0] != HUFFMAN_MODE_CODED || input_size < HUFFMAN_PREFIX + HUFFMAN_LENGTHS)
+    {
+        return -1;
+    }
+
+    uint8_t lengths[256];
+    uint16_t codes[256];
+    const uint8_t *table_bytes = input + HUFFMAN_PREFIX;
+    for (int s = 0; s < 256; s += 2)
+    {
+        lengths[s] = table_bytes[s / 2] & 0x0F;
+        lengths[s + 1] = table_bytes[s / 2] >> 4;
+    }
+    if (assign_codes(lengths, codes) != 0)
+    {
+        return -1;
+    }
+
+    // Every HUFFMAN_MAX_BITS-bit window maps to (symbol | length << 8); 0 marks unused codes
+    uint16_t table[HUFFMAN_TABLE_SIZE];
+    memset(table, 0, sizeof(table));
+    for (int s = 0; s < 256; s++)
+    {
+        int len = lengths[s];
+        if (len == 0)
+        {
+            continue;
+        }
+        for (uint32_t fill = codes[s]; fill < HUFFMAN_TABLE_SIZE; fill += 1u << len)
+        {
+            table[fill] = (uint16_t)(s | (len << 8));
+        }
+    }
+
+    const uint8_t *in = table_bytes + HUFFMAN_LENGTHS;
+    size_t in_size = input_size - HUFFMAN_PREFIX - HUFFMAN_LENGTHS;
+    size_t pos = 0;
+    uint64_t acc = 0;
+    int bits = 0;
+    size_t consumed_bits = 0;
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        while (bits <= 56)
+        {
+            uint8_t byte = pos < in_size ? in[pos] : 0;
+            pos++;
+            acc |= (uint64_t)byte << bits;
+            bits += 8;
+        }
+        uint16_t entry = table[acc & (HUFFMAN_TABLE_SIZE - 1)];
+        int len = entry >> 8;
+        if (len == 0)
+        {
+            return -1;
+        }
+        output[i] = (uint8_t)entry;
+        acc >>= len;
+        bits -= len;
+        consumed_bits += (size_t)len;
+    }
+    if (consumed_bits > in_size * 8)
+    {
+        return -1;
+    }
+
+    *output_size = (size_t)count;
+    return 0;
+}
@@ -1,4 +1,8 @@
 #include <gtk/gtk.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <omp.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -309,43 +313,169 @@ static void print_usage(const char *program_name)
     printf("                          Compress INPUT (file or directory) to OUTPUT file\n");
     printf("  -d, --decompress INPUT OUTPUT\n");
     printf("                          Decompress INPUT file to OUTPUT (file or directory)\n");
-    printf("  (no arguments)          Launch GUI mode\n\n");
+    printf("  -x, --extract ARCHIVE PATH [OUTPUT]\n");
+    printf("                          Extract only the entry PATH from ARCHIVE into OUTPUT\n");
+    printf("                          (default: current directory, '-' for stdout)\n");
+    printf("  --stats                 With -c, -d or -x: print timings, throughput and sizes\n");
+    printf("  --stats-json            Same as --stats, as one JSON object\n");
+    printf("  -t, --threads N         Use N threads in total, across blocks and within each block\n");
+    printf("  --mem-limit SIZE        Keep blocks and workspaces under SIZE bytes (K, M, G suffixes;\n");
+    printf("                          'max' for no limit). Default: the cgroup's memory.max\n");
+    printf("  (no arguments)          Launch GUI mode\n");
+    printf("  Use '-' as INPUT to read stdin, or as the compress OUTPUT to write stdout\n\n");
     printf("Examples:\n");
     printf("  %s -c myfile.txt myfile.w          # Compress file\n", program_name);
     printf("  %s -c mydirectory/ archive.w       # Compress directory\n", program_name);
     printf("  %s -d archive.w extracted/         # Decompress to directory\n", program_name);
+    printf("  %s -x archive.w conf/app.ini -     # Print one file from the archive\n", program_name);
+    printf("  tar c dir | %s -c - - > dir.w      # Compress a pipe\n", program_name);
+    printf("  %s -c big/ big.w --stats           # Compress and show where the time went\n", program_name);
+    printf("  %s -d big.w out/ --mem-limit 512M  # Decompress within 512 MiB\n", program_name);
     printf("  %s                                 # Launch GUI\n", program_name);
 }
 
+// How --stats and --stats-json report a command
+typedef enum
+{
+    CLI_STATS_NONE,
+    CLI_STATS_TEXT,
+    CLI_STATS_JSON
+} cli_stats_t;
+
+// Options accepted anywhere on the command line
+typedef struct
+{
+    cli_stats_t stats;
+    uint64_t memory_limit; // fm_config_t.memory_limit
+    int threads;           // bwt_config_t.threads, 0 for the OpenMP default
+} cli_options_t;
+
+// Config for one command; stats points at the caller's figures when requested
+static void cli_config(fm_config_t *cfg, const cli_options_t *options, fm_stats_t *stats)
+{
+    fm_config_init(cfg);
+    cfg->stats = options->stats != CLI_STATS_NONE ? stats : NULL;
+    cfg->memory_limit = options->memory_limit;
+    cfg->bwt.threads = options->threads;
+}
+
+static double megabytes_per_second(uint64_t bytes, double seconds)
+{
+    return seconds > 0 ? (double)bytes / seconds / 1e6 : 0.0;
+}
+
+// Prints what one call measured
+static void print_stats(FILE *log, const char *operation, const fm_stats_t *stats, cli_stats_t mode)
+{
+    double ratio = stats->archive_bytes ? (double)stats->original_bytes / (double)stats->archive_bytes : 0.0;
+    if (mode == CLI_STATS_JSON)
+    {
+        fprintf(log, "{\"operation\": \"%s\", \"seconds\": %.6f, \"read_seconds\": %.6f, \"write_seconds\": %.6f, ",
+                operation, stats->seconds, stats->read_seconds, stats->write_seconds);
+        fprintf(log, "\"threads\": %d, \"files\": %llu, \"blocks\": %llu, \"stored_blocks\": %llu, ",
+                stats->threads, (unsigned long long)stats->files, (unsigned long long)stats->blocks,
+                (unsigned long long)stats->stored_blocks);
+        fprintf(log, "\"rle_blocks\": %llu, \"original_bytes\": %llu, ", (unsigned long long)stats->rle_blocks,
+                (unsigned long long)stats->original_bytes);
+        fprintf(log, "\"archive_bytes\": %llu, \"ratio\": %.4f, \"mb_s\": %.2f, \"allocations\": %llu, ",
+                (unsigned long long)stats->archive_bytes, ratio,
+                megabytes_per_second(stats->original_bytes, stats->seconds),
+                (unsigned long long)stats->allocations);
+        fprintf(log, "\"allocated_bytes\": %llu, \"doubling_rounds\": %llu, ",
+                (unsigned long long)stats->allocated_bytes, (unsigned long long)stats->doubling_rounds);
+        if (stats->memory_limit == FM_MEMORY_UNLIMITED)
+        {
+            fprintf(log, "\"memory_limit\": null, \"stages\": {");
+        }
+        else
+        {
+            fprintf(log, "\"memory_limit\": %llu, \"stages\": {", (unsigned long long)stats->memory_limit);
+        }
+        for (int i = 0; i < FM_STATS_STAGES; i++)
+        {
+            fprintf(log, "%s\"%s\": {\"seconds\": %.6f, \"bytes_in\": %llu, \"bytes_out\": %llu}", i ? ", " : "",
+                    fm_stats_stage_name(i), stats->stage_seconds[i], (unsigned long long)stats->stage_bytes_in[i],
+                    (unsigned long long)stats->stage_bytes_out[i]);
+        }
+        fprintf(log, "}}\n");
+        return;
+    }
+
+    fprintf(log, "Time:       %.3f s (reading %.3f s, writing %.3f s), %d threads\n", stats->seconds,
+            stats->read_seconds, stats->write_seconds, stats->threads);
+    fprintf(log, "Data:       %llu bytes in %llu files and %llu blocks, %.2f MB/s\n",
+            (unsigned long long)stats->original_bytes, (unsigned long long)stats->files,
+            (unsigned long long)stats->blocks, megabytes_per_second(stats->original_bytes, stats->seconds));
+    fprintf(log, "Archive:    %llu bytes, ratio %.2f\n", (unsigned long long)stats->archive_bytes, ratio);
+    if (stats->stored_blocks > 0 || stats->rle_blocks > 0)
+    {
+        fprintf(log, "Blocks:     %llu stored as is, %llu run-length coded without BWT\n",
+                (unsigned long long)stats->stored_blocks, (unsigned long long)stats->rle_blocks);
+    }
+    for (int i = 0; i < FM_STATS_STAGES; i++)
+    {
+        if (stats->stage_bytes_in[i] > 0)
+        {
+            fprintf(log, "  %-8s  %.3f s, %llu -> %llu bytes, %.2f MB/s\n", fm_stats_stage_name(i),
+                    stats->stage_seconds[i], (unsigned long long)stats->stage_bytes_in[i],
+                    (unsigned long long)stats->stage_bytes_out[i],
+                    megabytes_per_second(stats->stage_bytes_in[i], stats->stage_seconds[i]));
+        }
+    }
+    fprintf(log, "Memory:     %llu bytes allocated, %llu BWT workspace allocations, %llu doubling rounds\n",
+            (unsigned long long)stats->allocated_bytes, (unsigned long long)stats->allocations,
+            (unsigned long long)stats->doubling_rounds);
+    if (stats->memory_limit != FM_MEMORY_UNLIMITED)
+    {
+        fprintf(log, "Limit:      %llu bytes\n", (unsigned long long)stats->memory_limit);
+    }
+}
+
 // CLI mode for compression
-static int cli_compress(const char *input, const char *output)
+static int cli_compress(const char *input, const char *output, const cli_options_t *options)
 {
-    printf("Compressing '%s' to '%s'...\n", input, output);
+    // Keep progress messages out of an archive written to stdout
+    FILE *log = strcmp(output, "-") == 0 ? stderr : stdout;
+    fprintf(log, "Compressing '%s' to '%s'...\n", input, output);
 
-    fm_status_t status = fm_compress(input, output);
+    fm_config_t cfg;
+    fm_stats_t stats;
+    cli_config(&cfg, options, &stats);
+    fm_status_t status = fm_compress_ex(input, output, &cfg);
 
     if (status == FM_STATUS_OK)
     {
-        printf("Compression completed successfully.\n");
+        fprintf(log, "Compression completed successfully.\n");
+        if (cfg.stats)
+        {
+            print_stats(log, "compress", &stats, options->stats);
+        }
         return 0;
     }
     else
     {
-        printf("Compression failed (error code: %d)\n", status);
+        fprintf(log, "Compression failed (error code: %d)\n", status);
         return 1;
     }
 }
 
 // CLI mode for decompression
-static int cli_decompress(const char *input, const char *output)
+static int cli_decompress(const char *input, const char *output, const cli_options_t *options)
 {
     printf("Decompressing '%s' to '%s'...\n", input, output);
 
-    fm_status_t status = fm_decompress(input, output);
+    fm_config_t cfg;
+    fm_stats_t stats;
+    cli_config(&cfg, options, &stats);
+    fm_status_t status = fm_decompress_ex(input, output, &cfg);
 
     if (status == FM_STATUS_OK)
     {
         printf("Decompression completed successfully.\n");
+        if (cfg.stats)
+        {
+            print_stats(stdout, "decompress", &stats, options->stats);
+        }
         return 0;
     }
     else
@@ -355,12 +485,134 @@ static int cli_decompress(const char *input, const char *output)
     }
 }
 
+// CLI mode for single-entry extraction
+static int cli_extract(const char *archive, const char *path, const char *output, const cli_options_t *options)
+{
+    // Keep progress messages out of an entry written to stdout
+    FILE *log = strcmp(output, "-") == 0 ? stderr : stdout;
+    fprintf(log, "Extracting '%s' from '%s' to '%s'...\n", path, archive, output);
+
+    fm_config_t cfg;
+    fm_stats_t stats;
+    cli_config(&cfg, options, &stats);
+    fm_status_t status = fm_extract_one(archive, path, output, &cfg);
+
+    if (status == FM_STATUS_OK)
+    {
+        fprintf(log, "Extraction completed successfully.\n");
+        if (cfg.stats)
+        {
+            print_stats(log, "extract", &stats, options->stats);
+        }
+        return 0;
+    }
+    else if (status == FM_STATUS_FILE_NOT_FOUND)
+    {
+        fprintf(stderr, "Entry '%s' not found in '%s'\n", path, archive);
+        return 1;
+    }
+    else
+    {
+        fprintf(log, "Extraction failed (error code: %d)\n", status);
+        return 1;
+    }
+}
+
+// Parses a byte count such as 4096, 512K, 2G or "max"; returns 0 when malformed
+static int parse_size(const char *text, uint64_t *bytes)
+{
+    if (strcmp(text, "max") == 0)
+    {
+        *bytes = FM_MEMORY_UNLIMITED;
+        return 1;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text || errno != 0 || value == 0 || text[0] == '-')
+    {
+        return 0;
+    }
+    const char *units = "KMGT";
+    const char *unit = *end ? strchr(units, toupper((unsigned char)*end)) : NULL;
+    if (*end && (!unit || (end[1] && strcmp(end + 1, "B") != 0 && strcmp(end + 1, "iB") != 0)))
+    {
+        return 0;
+    }
+    for (const char *u = units; unit && u <= unit; u++)
+    {
+        if (value > ULLONG_MAX / 1024)
+        {
+            return 0;
+        }
+        value *= 1024;
+    }
+    *bytes = value;
+    return 1;
+}
+
+// Takes the options out of argv, wherever they are, leaving the command and its paths.
+// Returns 0 on a malformed option.
+static int take_cli_options(int *argc, char **argv, cli_options_t *options)
+{
+    int kept = 1;
+    for (int i = 1; i < *argc; i++)
+    {
+        if (strcmp(argv[i], "--stats") == 0)
+        {
+            options->stats = CLI_STATS_TEXT;
+        }
+        else if (strcmp(argv[i], "--stats-json") == 0)
+        {
+            options->stats = CLI_STATS_JSON;
+        }
+        else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0)
+        {
+            char *end = NULL;
+            long threads = i + 1 < *argc ? strtol(argv[++i], &end, 10) : 0;
+            if (!end || *end != '\0' || threads < 1 || threads > 4096)
+            {
+                return 0;
+            }
+            options->threads = (int)threads;
+        }
+        else if (strcmp(argv[i], "--mem-limit") == 0)
+        {
+            if (i + 1 >= *argc || !parse_size(argv[++i], &options->memory_limit))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            argv[kept++] = argv[i];
+        }
+    }
+    *argc = kept;
+    return 1;
+}
+
 int main(int argc, char **argv)
 {
     // Check if running in CLI mode
     if (argc > 1)
     {
         // Parse command line arguments
+        cli_options_t options = {CLI_STATS_NONE, 0, 0};
+        if (!take_cli_options(&argc, argv, &options))
+        {
+            printf("Error: Invalid option value\n\n");
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        // One call at a time runs here, so the process may enable the nested
+        // regions that let a call share its threads inside blocks as well
+        if (omp_get_max_active_levels() < 2 && !getenv("OMP_MAX_ACTIVE_LEVELS"))
+        {
+            omp_set_max_active_levels(2);
+        }
+
         if (argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
         {
             print_usage(argv[0]);
@@ -369,12 +621,17 @@ int main(int argc, char **argv)
 
         if (argc == 4 && (strcmp(argv[1], "-c") == 0 || strcmp(argv[1], "--compress") == 0))
         {
-            return cli_compress(argv[2], argv[3]);
+            return cli_compress(argv[2], argv[3], &options);
         }
 
         if (argc == 4 && (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "--decompress") == 0))
         {
-            return cli_decompress(argv[2], argv[3]);
+            return cli_decompress(argv[2], argv[3], &options);
+        }
+
+        if ((argc == 4 || argc == 5) && (strcmp(argv[1], "-x") == 0 || strcmp(argv[1], "--extract") == 0))
+        {
+            return cli_extract(argv[2], argv[3], argc == 5 ? argv[4] : ".", &options);
         }
 
         // Invalid arguments
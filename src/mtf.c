@@ -0,0 +1,66 @@
+#include "mtf.h"
+
+#include <string.h>
+
+// Each byte is replaced by its position in a recency list, then moved to the front.
+// After BWT most positions are small, which the entropy coder turns into short codes.
+void mtf_encode(const uint8_t *input, size_t input_size, uint8_t *output)
+{
+    uint8_t order[256];
+
+    if (input == NULL || output == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        order[i] = (uint8_t)i;
+    }
+
+    for (size_t i = 0; i < input_size; i++)
+    {
+        uint8_t current_byte = input[i];
+        uint8_t position = 0;
+
+        while (order[position] != current_byte)
+        {
+            position++;
+        }
+
+        if (position > 0)
+        {
+            memmove(order + 1, order, position);
+            order[0] = current_byte;
+        }
+        output[i] = position;
+    }
+}
+
+void mtf_decode(const uint8_t *input, size_t input_size, uint8_t *output)
+{
+    uint8_t order[256];
+
+    if (input == NULL || output == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        order[i] = (uint8_t)i;
+    }
+
+    for (size_t i = 0; i < input_size; i++)
+    {
+        uint8_t position = input[i];
+        uint8_t current_byte = order[position];
+
+        if (position > 0)
+        {
+            memmove(order + 1, order, position);
+            order[0] = current_byte;
+        }
+        output[i] = current_byte;
+    }
+}
@@ -0,0 +1,343 @@
+#include "pipeline.h"
+#include "huffman.h"
+#include "mtf.h"
+#include "rle.h"
+
+#include <math.h>
+#include <omp.h>
+#include <string.h>
+
+static const uint32_t stage_order[] = {
+    PIPELINE_STAGE_BWT,
+    PIPELINE_STAGE_MTF,
+    PIPELINE_STAGE_RLE,
+    PIPELINE_STAGE_HUFFMAN
+};
+#define STAGE_COUNT PIPELINE_STAGE_COUNT
+
+// Size bound of a stage's output for an input of 'size' bytes
+static size_t stage_bound(uint32_t stage, size_t size)
+{
+    switch (stage)
+    {
+    case PIPELINE_STAGE_RLE:
+        return rle_max_encoded_size(RLE_MODE_ESCAPED, size);
+    case PIPELINE_STAGE_HUFFMAN:
+        return huffman_max_encoded_size(size);
+    default:
+        return size;
+    }
+}
+
+size_t pipeline_max_encoded_size(uint32_t stages, size_t input_size)
+{
+    size_t size = input_size;
+    size_t bound = input_size ? input_size : 1;
+    for (size_t i = 0; i < STAGE_COUNT; i++)
+    {
+        if (stages & stage_order[i])
+        {
+            size = stage_bound(stage_order[i], size);
+            if (size > bound)
+            {
+                bound = size;
+            }
+        }
+    }
+    return bound;
+}
+
+static int stage_count(uint32_t stages)
+{
+    int count = 0;
+    for (size_t i = 0; i < STAGE_COUNT; i++)
+    {
+        count += (stages & stage_order[i]) != 0;
+    }
+    return count;
+}
+
+// Windows the scan spreads its sample over, so a block's header alone does not decide
+#define SCAN_WINDOWS 16
+// At or above this entropy with few runs and repeats, a block is stored:
+// compressed media lands here, and BWT would only burn CPU on it. The
+// repeat check keeps weak compressors' output (gzip of logs, say), whose
+// bytes look flat but whose long matches BWT still finds
+#define SCAN_STORE_ENTROPY 7.8
+#define SCAN_STORE_RUNS 0.02
+#define SCAN_STORE_REPEATS 0.01
+// Slots in the table of recently seen 4-byte strings
+#define SCAN_REPEAT_BITS 12
+// At or above this run density, run-length and entropy coding without the
+// BWT get nearly all there is to get
+#define SCAN_RLE_RUNS 0.9
+
+void pipeline_scan(const uint8_t *input, size_t input_size, pipeline_scan_t *scan)
+{
+    memset(scan, 0, sizeof(*scan));
+    if (!input || input_size == 0)
+    {
+        return;
+    }
+    size_t counts[256] = {0};
+    uint32_t seen[1u << SCAN_REPEAT_BITS] = {0};
+    size_t runs = 0;
+    size_t repeats = 0;
+    size_t grams = 0;
+    size_t windows = input_size > PIPELINE_SCAN_SAMPLE ? SCAN_WINDOWS : 1;
+    size_t window = input_size > PIPELINE_SCAN_SAMPLE ? PIPELINE_SCAN_SAMPLE / SCAN_WINDOWS : input_size;
+    size_t gap = windows > 1 ? (input_size - window) / (windows - 1) : 0;
+    for (size_t w = 0; w < windows; w++)
+    {
+        const uint8_t *p = input + w * gap;
+        counts[p[0]]++;
+        for (size_t i = 1; i < window; i++)
+        {
+            counts[p[i]]++;
+            runs += p[i] == p[i - 1];
+        }
+        for (size_t i = 0; i + 4 <= window; i++)
+        {
+            uint32_t gram;
+            memcpy(&gram, p + i, sizeof(gram));
+            uint32_t slot = (gram * 2654435761u) >> (32 - SCAN_REPEAT_BITS);
+            repeats += seen[slot] == gram && gram != 0;
+            seen[slot] = gram;
+            grams++;
+        }
+    }
+
+    size_t sampled = windows * window;
+    double entropy = 0.0;
+    size_t distinct = 0;
+    for (int c = 0; c < 256; c++)
+    {
+        if (counts[c])
+        {
+            double p = (double)counts[c] / (double)sampled;
+            entropy -= p * log2(p);
+            distinct++;
+        }
+    }
+    scan->entropy = entropy;
+    scan->run_density = sampled > windows ? (double)runs / (double)(sampled - windows) : 0.0;
+    scan->repeats = grams ? (double)repeats / (double)grams : 0.0;
+    scan->distinct = distinct;
+    scan->sampled = sampled;
+}
+
+uint32_t pipeline_choose_stages(uint32_t stages, const uint8_t *input, size_t input_size)
+{
+    if (!input || input_size == 0)
+    {
+        return stages;
+    }
+    pipeline_scan_t scan;
+    pipeline_scan(input, input_size, &scan);
+    if (scan.entropy >= SCAN_STORE_ENTROPY && scan.run_density < SCAN_STORE_RUNS &&
+        scan.repeats < SCAN_STORE_REPEATS)
+    {
+        return 0;
+    }
+    if (scan.run_density >= SCAN_RLE_RUNS && (stages & PIPELINE_STAGE_RLE))
+    {
+        return stages & (PIPELINE_STAGE_RLE | PIPELINE_STAGE_HUFFMAN);
+    }
+    return stages;
+}
+
+// Snapshot taken before a stage so stage_record can add what it cost
+typedef struct
+{
+    double started;
+    size_t allocations;
+    size_t doubling_rounds;
+} stage_mark_t;
+
+static stage_mark_t stage_begin(const pipeline_stats_t *stats, const bwt_context_t *ctx)
+{
+    stage_mark_t mark = {0, 0, 0};
+    if (stats)
+    {
+        mark.started = omp_get_wtime();
+        mark.allocations = ctx ? ctx->allocations : 0;
+        mark.doubling_rounds = ctx ? ctx->doubling_rounds : 0;
+    }
+    return mark;
+}
+
+static void stage_record(pipeline_stats_t *stats, const bwt_context_t *ctx, const stage_mark_t *mark, size_t stage,
+                         size_t in, size_t out)
+{
+    if (!stats)
+    {
+        return;
+    }
+    stats->seconds[stage] += omp_get_wtime() - mark->started;
+    stats->bytes_in[stage] += in;
+    stats->bytes_out[stage] += out;
+    if (ctx)
+    {
+        stats->allocations += ctx->allocations - mark->allocations;
+        stats->doubling_rounds += ctx->doubling_rounds - mark->doubling_rounds;
+    }
+}
+
+/*
+  Stages ping-pong between output and scratch. The first stage writes to
+  whichever buffer makes the last stage land in output.
+*/
+pipeline_status_t pipeline_encode(const bwt_config_t *cfg, bwt_context_t *ctx, uint32_t stages,
+                                  const uint8_t *input, size_t input_size,
+                                  uint8_t *output, size_t *output_size, uint8_t *scratch,
+                                  pipeline_block_t *block, pipeline_stats_t *stats)
+{
+    if (!input || !output || !output_size || !scratch || !block || (stages & ~PIPELINE_STAGE_MASK))
+    {
+        return PIPELINE_STATUS_INVALID_ARGUMENT;
+    }
+
+    size_t capacity = pipeline_max_encoded_size(stages, input_size);
+    int remaining = stage_count(stages);
+    uint8_t *dst = (remaining % 2) ? output : scratch;
+    const uint8_t *src = input;
+    size_t size = input_size;
+
+    block->stages = stages;
+    block->chain_count = 0;
+
+    for (size_t i = 0; i < STAGE_COUNT; i++)
+    {
+        uint32_t stage = stage_order[i];
+        if (!(stages & stage))
+        {
+            continue;
+        }
+
+        size_t out_size = size;
+        stage_mark_t mark = stage_begin(stats, ctx);
+        switch (stage)
+        {
+        case PIPELINE_STAGE_BWT:
+        {
+            size_t chains = cfg->chains;
+            if (chains == 0 || chains > BWT_MAX_CHAINS)
+            {
+                chains = chains ? BWT_MAX_CHAINS : 1;
+            }
+            block->chain_count = bwt_chain_count(size, chains);
+            bwt_status_t status = bwt_forward_chains_ctx(ctx, cfg, src, size, dst, block->chain_index, chains);
+            if (status != BWT_STATUS_OK)
+            {
+                return status == BWT_STATUS_ALLOCATION_FAILURE ? PIPELINE_STATUS_ALLOCATION_FAILURE
+                                                               : PIPELINE_STATUS_INVALID_ARGUMENT;
+            }
+            break;
+        }
+        case PIPELINE_STAGE_MTF:
+            mtf_encode(src, size, dst);
+            break;
+        case PIPELINE_STAGE_RLE:
+            out_size = capacity;
+            rle_encode_escaped(src, size, dst, &out_size);
+            break;
+        case PIPELINE_STAGE_HUFFMAN:
+            out_size = capacity;
+            if (huffman_encode(src, size, dst, &out_size) != 0)
+            {
+                return PIPELINE_STATUS_INVALID_ARGUMENT;
+            }
+            break;
+        }
+
+        stage_record(stats, ctx, &mark, i, size, out_size);
+        src = dst;
+        size = out_size;
+        dst = (dst == output) ? scratch : output;
+    }
+
+    if (src == input && size > 0)
+    {
+        memcpy(output, input, size); // no stages: store the block as is
+    }
+    *output_size = size;
+    return PIPELINE_STATUS_OK;
+}
+
+pipeline_status_t pipeline_decode(const bwt_config_t *cfg, bwt_context_t *ctx,
+                                  const pipeline_block_t *block, const uint8_t *input, size_t input_size,
+                                  uint8_t *output, size_t original_size, uint8_t *scratch,
+                                  pipeline_stats_t *stats)
+{
+    if (!block || !input || !output || !scratch || (block->stages & ~PIPELINE_STAGE_MASK))
+    {
+        return PIPELINE_STATUS_INVALID_ARGUMENT;
+    }
+
+    uint32_t stages = block->stages;
+    size_t capacity = pipeline_max_encoded_size(stages, original_size);
+    if (input_size > capacity)
+    {
+        return PIPELINE_STATUS_CORRUPT_DATA;
+    }
+
+    int remaining = stage_count(stages);
+    uint8_t *dst = (remaining % 2) ? output : scratch;
+    const uint8_t *src = input;
+    size_t size = input_size;
+
+    for (size_t i = STAGE_COUNT; i-- > 0;)
+    {
+        uint32_t stage = stage_order[i];
+        if (!(stages & stage))
+        {
+            continue;
+        }
+
+        size_t out_size = size;
+        stage_mark_t mark = stage_begin(stats, ctx);
+        switch (stage)
+        {
+        case PIPELINE_STAGE_HUFFMAN:
+            out_size = capacity;
+            if (huffman_decode(src, size, dst, &out_size) != 0)
+            {
+                return PIPELINE_STATUS_CORRUPT_DATA;
+            }
+            break;
+        case PIPELINE_STAGE_RLE:
+            out_size = original_size;
+            rle_decode_escaped(src, size, dst, &out_size);
+            break;
+        case PIPELINE_STAGE_MTF:
+            mtf_decode(src, size, dst);
+            break;
+        case PIPELINE_STAGE_BWT:
+            if (size != original_size || block->chain_count == 0 || block->chain_count > BWT_MAX_CHAINS)
+            {
+                return PIPELINE_STATUS_CORRUPT_DATA;
+            }
+            if (size > 0 && bwt_inverse_chains_ctx(ctx, cfg, src, size, block->chain_index, block->chain_count,
+                                                   dst) != BWT_STATUS_OK)
+            {
+                return PIPELINE_STATUS_CORRUPT_DATA;
+            }
+            break;
+        }
+
+        stage_record(stats, ctx, &mark, i, size, out_size);
+        src = dst;
+        size = out_size;
+        dst = (dst == output) ? scratch : output;
+    }
+
+    if (size != original_size)
+    {
+        return PIPELINE_STATUS_CORRUPT_DATA;
+    }
+    if (src == input && size > 0)
+    {
+        memcpy(output, input, size);
+    }
+    return PIPELINE_STATUS_OK;
+}
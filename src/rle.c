@@ -6,6 +6,137 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RLE_HAVE_X86 1
+#endif
+
+/*
+  Run detection kernels. run_length counts the leading bytes of p[0..max)
+  equal to p[0] (max >= 1); run_start returns the first offset i with
+  p[i] == p[i + 1] == p[i + 2], or len when the buffer has no such run.
+  The vector versions compare 16 or 32 bytes at once and locate the first
+  mismatch or match with a movemask, so they return exactly what the
+  scalar versions return.
+*/
+typedef size_t (*rle_scan_fn)(const uint8_t *p, size_t n);
+
+static size_t run_length_scalar(const uint8_t *p, size_t max)
+{
+    size_t n = 1;
+    while (n < max && p[n] == p[0])
+    {
+        n++;
+    }
+    return n;
+}
+
+static size_t run_start_scalar(const uint8_t *p, size_t len)
+{
+    for (size_t i = 0; i + 2 < len; i++)
+    {
+        if (p[i] == p[i + 1] && p[i + 1] == p[i + 2])
+        {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef RLE_HAVE_X86
+__attribute__((target("sse2"))) static size_t run_length_sse2(const uint8_t *p, size_t max)
+{
+    __m128i value = _mm_set1_epi8((char)p[0]);
+    size_t n = 1;
+    while (n + 16 <= max)
+    {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + n)), value));
+        if (mask != 0xFFFFu)
+        {
+            return n + (size_t)__builtin_ctz(~mask);
+        }
+        n += 16;
+    }
+    return n + run_length_scalar(p + n - 1, max - n + 1) - 1;
+}
+
+__attribute__((target("sse2"))) static size_t run_start_sse2(const uint8_t *p, size_t len)
+{
+    size_t i = 0;
+    while (i + 18 <= len)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + i + 1));
+        __m128i c = _mm_loadu_si128((const __m128i *)(p + i + 2));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, b), _mm_cmpeq_epi8(b, c)));
+        if (mask != 0)
+        {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+        i += 16;
+    }
+    return i + run_start_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t run_length_avx2(const uint8_t *p, size_t max)
+{
+    __m256i value = _mm256_set1_epi8((char)p[0]);
+    size_t n = 1;
+    while (n + 32 <= max)
+    {
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + n)), value));
+        if (mask != 0xFFFFFFFFu)
+        {
+            return n + (size_t)__builtin_ctz(~mask);
+        }
+        n += 32;
+    }
+    return n + run_length_scalar(p + n - 1, max - n + 1) - 1;
+}
+
+__attribute__((target("avx2"))) static size_t run_start_avx2(const uint8_t *p, size_t len)
+{
+    size_t i = 0;
+    while (i + 34 <= len)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + 1));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(p + i + 2));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, b), _mm256_cmpeq_epi8(b, c)));
+        if (mask != 0)
+        {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+        i += 32;
+    }
+    return i + run_start_scalar(p + i, len - i);
+}
+#endif
+
+// The kernels in use, one of the run_length_* and run_start_* versions above
+static rle_scan_fn scan_run = run_length_scalar;
+static rle_scan_fn scan_run_start = run_start_scalar;
+
+// Pick the widest kernels the CPU supports before any thread can call them
+__attribute__((constructor)) static void rle_select_kernels(void)
+{
+#ifdef RLE_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        scan_run = run_length_avx2;
+        scan_run_start = run_start_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        scan_run = run_length_sse2;
+        scan_run_start = run_start_sse2;
+    }
+#endif
+}
+
 void rle_encode(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size)
 {
     size_t out_index = 0;
@@ -23,12 +154,8 @@ void rle_encode(const uint8_t *input, size_t input_size, uint8_t *output, size_t
     while (i < input_size)
     {
         uint8_t current_byte = input[i];
-        size_t run_length = 1;
-
-        while (i + run_length < input_size && input[i + run_length] == current_byte && run_length < 255)
-        {
-            run_length++;
-        }
+        size_t remaining = input_size - i;
+        size_t run = scan_run(input + i, remaining < 255 ? remaining : 255);
 
         // Check for buffer overflow before writing
         if (out_index + 2 > max_output_size)
@@ -38,9 +165,9 @@ void rle_encode(const uint8_t *input, size_t input_size, uint8_t *output, size_t
         }
 
         output[out_index++] = current_byte;
-        output[out_index++] = (uint8_t)run_length;
+        output[out_index++] = (uint8_t)run;
 
-        i += run_length;
+        i += run;
     }
 
     *output_size = out_index;
@@ -56,18 +183,137 @@ void rle_decode(const uint8_t *input, size_t input_size, uint8_t *output, size_t
         return;
     }
 
-    while (i < input_size)
+    // *output_size is the capacity of the output buffer
+    size_t max_output_size = (*output_size);
+
+    while (i + 1 < input_size)
     {
         uint8_t current_byte = input[i];
         uint8_t run_length = input[i + 1];
 
-        for (size_t j = 0; j < run_length; j++)
+        // Stop on malformed input rather than writing past the buffer
+        if (out_index + run_length > max_output_size)
         {
-            output[out_index++] = current_byte;
+            break;
         }
 
+        memset(output + out_index, current_byte, run_length);
+        out_index += run_length;
+
         i += 2;
     }
 
     *output_size = out_index;
 }
+
+size_t rle_max_encoded_size(rle_mode_t mode, size_t input_size)
+{
+    if (mode == RLE_MODE_PAIRS)
+    {
+        return input_size * 2;
+    }
+    // Incompressible input is all literal packets of up to 128 bytes
+    return input_size + (input_size + 127) / 128;
+}
+
+/*
+  Escaped mode packets start with a header byte:
+    0..127    header + 1 literal bytes follow
+    128..255  the next byte repeats header - 128 + RLE_MIN_RUN times
+  A repeat packet always saves at least one byte, which pays for the
+  literal header it may split, so the output never exceeds
+  rle_max_encoded_size(RLE_MODE_ESCAPED, input_size).
+*/
+void rle_encode_escaped(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size)
+{
+    size_t out_index = 0;
+    size_t i = 0;
+
+    if (input == NULL || output == NULL || output_size == NULL)
+    {
+        return;
+    }
+
+    size_t max_output_size = (*output_size);
+    int full = 0;
+
+    while (i < input_size)
+    {
+        // Everything before the next run of RLE_MIN_RUN bytes goes out as literals
+        size_t literal_end = i + scan_run_start(input + i, input_size - i);
+        while (i < literal_end)
+        {
+            size_t literals = literal_end - i < 128 ? literal_end - i : 128;
+            if (out_index + 1 + literals > max_output_size)
+            {
+                full = 1;
+                break;
+            }
+            output[out_index++] = (uint8_t)(literals - 1);
+            memcpy(output + out_index, input + i, literals);
+            out_index += literals;
+            i += literals;
+        }
+
+        if (full || i == input_size)
+        {
+            break;
+        }
+
+        size_t remaining = input_size - i;
+        size_t run = scan_run(input + i, remaining < RLE_MAX_RUN ? remaining : RLE_MAX_RUN);
+        if (out_index + 2 > max_output_size)
+        {
+            break;
+        }
+        output[out_index++] = (uint8_t)(128 + run - RLE_MIN_RUN);
+        output[out_index++] = input[i];
+        i += run;
+    }
+
+    *output_size = out_index;
+}
+
+void rle_decode_escaped(const uint8_t *input, size_t input_size, uint8_t *output, size_t *output_size)
+{
+    size_t out_index = 0;
+    size_t i = 0;
+
+    if (input == NULL || output == NULL || output_size == NULL)
+    {
+        return;
+    }
+
+    // *output_size is the capacity of the output buffer
+    size_t max_output_size = (*output_size);
+
+    while (i < input_size)
+    {
+        uint8_t header = input[i++];
+
+        if (header < 128)
+        {
+            size_t literals = (size_t)header + 1;
+            // Stop on truncated or oversized packets rather than reading or writing past a buffer
+            if (i + literals > input_size || out_index + literals > max_output_size)
+            {
+                break;
+            }
+            memcpy(output + out_index, input + i, literals);
+            out_index += literals;
+            i += literals;
+        }
+        else
+        {
+            size_t run_length = (size_t)header - 128 + RLE_MIN_RUN;
+            if (i >= input_size || out_index + run_length > max_output_size)
+            {
+                break;
+            }
+            memset(output + out_index, input[i++], run_length);
+            out_index += run_length;
+        }
+    }
+
+    *output_size = out_index;
+}
@@ -0,0 +1,254 @@
+/*
+  SA-IS suffix sorting, instantiated once per index width by bwt.c.
+  Before including, define:
+    SAIS_IDX       index type of the suffix array (uint32_t or size_t)
+    SAIS_EMPTY     unused-slot marker (the maximum value of SAIS_IDX)
+    SAIS_FN(name)  name mangling for this instantiation
+*/
+
+#ifndef SAIS_IMPL_HELPERS
+#define SAIS_IMPL_HELPERS
+
+// Type bitmap helpers: bit set means S-type, clear means L-type.
+#define SAIS_TGET(i) ((types[(i) >> 3] >> ((i) & 7)) & 1)
+#define SAIS_TSET(i, b) (types[(i) >> 3] = (uint8_t)((b) ? (types[(i) >> 3] | (1u << ((i) & 7))) \
+                                                          : (types[(i) >> 3] & ~(1u << ((i) & 7)))))
+#define SAIS_IS_LMS(i) ((i) > 0 && SAIS_TGET(i) && !SAIS_TGET((i) - 1))
+
+#endif
+
+// Character access: level 0 works on bytes, deeper levels on names.
+#undef SAIS_CHR
+#define SAIS_CHR(i) (cs == sizeof(uint8_t) ? (size_t)((const uint8_t *)T)[i] : (size_t)((const SAIS_IDX *)T)[i])
+
+static void SAIS_FN(sais_get_buckets)(const SAIS_IDX *counts, SAIS_IDX *buckets, size_t k, int end) {
+    size_t sum = 0;
+    for (size_t c = 0; c < k; ++c) {
+        sum += counts[c];
+        buckets[c] = (SAIS_IDX)(end ? sum : sum - counts[c]);
+    }
+}
+
+// Induce L-type suffixes left to right, then S-type suffixes right to left.
+// The empty suffix acts as a virtual sentinel smaller than every symbol, so
+// suffix n-1 (always L-type) is seeded first instead of being induced.
+static void SAIS_FN(sais_induce)(const void *T, size_t cs, SAIS_IDX *SA, size_t n, size_t k,
+                                 const uint8_t *types, const SAIS_IDX *counts, SAIS_IDX *buckets) {
+    SAIS_FN(sais_get_buckets)(counts, buckets, k, 0);
+    SA[buckets[SAIS_CHR(n - 1)]++] = (SAIS_IDX)(n - 1);
+    for (size_t i = 0; i < n; ++i) {
+        size_t j = SA[i];
+        if (j != SAIS_EMPTY && j > 0 && !SAIS_TGET(j - 1)) {
+            SA[buckets[SAIS_CHR(j - 1)]++] = (SAIS_IDX)(j - 1);
+        }
+    }
+
+    SAIS_FN(sais_get_buckets)(counts, buckets, k, 1);
+    for (size_t i = n; i-- > 0;) {
+        size_t j = SA[i];
+        if (j != SAIS_EMPTY && j > 0 && SAIS_TGET(j - 1)) {
+            SA[--buckets[SAIS_CHR(j - 1)]] = (SAIS_IDX)(j - 1);
+        }
+    }
+}
+
+// Compare two LMS substrings; the one running into the virtual sentinel is unique.
+static int SAIS_FN(sais_lms_equal)(const void *T, size_t cs, const uint8_t *types, size_t n,
+                                   size_t a, size_t b) {
+    for (size_t d = 0;; ++d) {
+        if (a + d == n || b + d == n) {
+            return 0;
+        }
+        if (SAIS_CHR(a + d) != SAIS_CHR(b + d) || SAIS_TGET(a + d) != SAIS_TGET(b + d)) {
+            return 0;
+        }
+        if (d > 0 && (SAIS_IS_LMS(a + d) || SAIS_IS_LMS(b + d))) {
+            return SAIS_IS_LMS(a + d) && SAIS_IS_LMS(b + d);
+        }
+    }
+}
+
+/*
+  Build the suffix array of T[0..n) over alphabet [0, k) by induced sorting
+  (Nong, Zhang & Chan). Suffix order matches the prefix-doubling engine: a
+  suffix that is a prefix of another sorts first.
+  spare/spare_len is unused suffix-array space the caller lends for the
+  bucket tables, so recursion levels do not allocate alphabet-sized arrays.
+  Other scratch comes from ctx.
+*/
+static bwt_status_t SAIS_FN(sais_main)(const void *T, size_t cs, SAIS_IDX *SA, size_t n, size_t k,
+                                       SAIS_IDX *spare, size_t spare_len, bwt_context_t *ctx) {
+    if (n == 0) {
+        return BWT_STATUS_OK;
+    }
+    if (n == 1) {
+        SA[0] = 0;
+        return BWT_STATUS_OK;
+    }
+
+    SAIS_IDX *tables = (2 * k <= spare_len) ? spare
+                                            : (SAIS_IDX *)ws_alloc(ctx, 2 * k * sizeof(SAIS_IDX));
+    uint8_t *types = (uint8_t *)ws_alloc(ctx, (n + 7) >> 3);
+    if (!tables || !types) {
+        if (tables && tables != spare) {
+            ws_free(ctx, tables);
+        }
+        if (types) {
+            ws_free(ctx, types);
+        }
+        return BWT_STATUS_ALLOCATION_FAILURE;
+    }
+    memset(types, 0, (n + 7) >> 3);
+    SAIS_IDX *counts = tables;
+    SAIS_IDX *buckets = tables + k;
+    memset(counts, 0, k * sizeof(SAIS_IDX));
+
+    SAIS_TSET(n - 1, 0);
+    for (size_t i = n - 1; i-- > 0;) {
+        size_t a = SAIS_CHR(i);
+        size_t b = SAIS_CHR(i + 1);
+        SAIS_TSET(i, a < b || (a == b && SAIS_TGET(i + 1)));
+    }
+    for (size_t i = 0; i < n; ++i) {
+        counts[SAIS_CHR(i)]++;
+    }
+
+    // Stage 1: sort LMS substrings.
+    SAIS_FN(sais_get_buckets)(counts, buckets, k, 1);
+    for (size_t i = 0; i < n; ++i) {
+        SA[i] = SAIS_EMPTY;
+    }
+    for (size_t i = 1; i < n; ++i) {
+        if (SAIS_IS_LMS(i)) {
+            SA[--buckets[SAIS_CHR(i)]] = (SAIS_IDX)i;
+        }
+    }
+    SAIS_FN(sais_induce)(T, cs, SA, n, k, types, counts, buckets);
+
+    size_t m = 0;
+    for (size_t i = 0; i < n; ++i) {
+        size_t pos = SA[i];
+        if (SAIS_IS_LMS(pos)) {
+            SA[m++] = (SAIS_IDX)pos;
+        }
+    }
+
+    // Name the sorted LMS substrings; LMS positions are at least two apart.
+    for (size_t i = m; i < n; ++i) {
+        SA[i] = SAIS_EMPTY;
+    }
+    size_t names = 0;
+    size_t prev = SAIS_EMPTY;
+    for (size_t i = 0; i < m; ++i) {
+        size_t pos = SA[i];
+        if (prev == SAIS_EMPTY || !SAIS_FN(sais_lms_equal)(T, cs, types, n, prev, pos)) {
+            names++;
+            prev = pos;
+        }
+        SA[m + (pos >> 1)] = (SAIS_IDX)(names - 1);
+    }
+    for (size_t i = n, j = n; i-- > m;) {
+        if (SA[i] != SAIS_EMPTY) {
+            SA[--j] = SA[i];
+        }
+    }
+
+    // Stage 2: sort the reduced string, recursing while names are not unique.
+    // SA[m..n-m) is free meanwhile and hosts the next level's bucket tables.
+    SAIS_IDX *reduced = SA + n - m;
+    bwt_status_t status = BWT_STATUS_OK;
+    if (names < m) {
+        status = SAIS_FN(sais_main)(reduced, sizeof(SAIS_IDX), SA, m, names, SA + m, n - 2 * m, ctx);
+    } else {
+        for (size_t i = 0; i < m; ++i) {
+            SA[reduced[i]] = (SAIS_IDX)i;
+        }
+    }
+    if (status != BWT_STATUS_OK) {
+        if (tables != spare) {
+            ws_free(ctx, tables);
+        }
+        ws_free(ctx, types);
+        return status;
+    }
+
+    // Stage 3: seed sorted LMS suffixes at bucket ends and induce the rest.
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        if (SAIS_IS_LMS(i)) {
+            reduced[j++] = (SAIS_IDX)i;
+        }
+    }
+    for (size_t i = 0; i < m; ++i) {
+        SA[i] = reduced[SA[i]];
+    }
+    for (size_t i = m; i < n; ++i) {
+        SA[i] = SAIS_EMPTY;
+    }
+    SAIS_FN(sais_get_buckets)(counts, buckets, k, 1);
+    for (size_t i = m; i-- > 0;) {
+        size_t j = SA[i];
+        SA[i] = SAIS_EMPTY;
+        SA[--buckets[SAIS_CHR(j)]] = (SAIS_IDX)j;
+    }
+    SAIS_FN(sais_induce)(T, cs, SA, n, k, types, counts, buckets);
+
+    if (tables != spare) {
+        ws_free(ctx, tables);
+    }
+    ws_free(ctx, types);
+    return BWT_STATUS_OK;
+}
+
+/*
+  Emit the BWT column from a sorted suffix array. chain_index[j] receives
+  the row of suffix j * stride (stride is a power of two), so
+  chain_index[0] is the primary index. The primary row is reduced out of
+  the parallel loops; every other chain slot has exactly one writer.
+  output may be input: rows are then packed into the front of each
+  thread's slice of sa, over entries already read, and copied out once no
+  thread reads input any more. sa is clobbered either way.
+*/
+static void SAIS_FN(bwt_emit)(const uint8_t *input, size_t length, SAIS_IDX *sa,
+                              uint8_t *output, size_t *chain_index, size_t stride) {
+    size_t primary = 0;
+    if (output != input) {
+#pragma omp parallel for schedule(static) reduction(max : primary) if (length > 1024)
+        for (size_t i = 0; i < length; ++i) {
+            size_t idx = sa[i];
+            output[i] = input[(idx == 0) ? (length - 1) : (idx - 1)];
+            if (idx == 0) {
+                primary = i;
+            } else if ((idx & (stride - 1)) == 0) {
+                chain_index[idx / stride] = i;
+            }
+        }
+        chain_index[0] = primary;
+        return;
+    }
+
+    int parts = length > 1024 ? omp_get_max_threads() : 1;
+    size_t span = (length + (size_t)parts - 1) / (size_t)parts;
+#pragma omp parallel for schedule(static) reduction(max : primary) if (parts > 1)
+    for (int p = 0; p < parts; ++p) {
+        size_t begin = (size_t)p * span;
+        size_t end = begin + span < length ? begin + span : length;
+        uint8_t *packed = (uint8_t *)(sa + begin);
+        for (size_t i = begin; i < end; ++i) {
+            size_t idx = sa[i];
+            packed[i - begin] = input[(idx == 0) ? (length - 1) : (idx - 1)];
+            if (idx == 0) {
+                primary = i;
+            } else if ((idx & (stride - 1)) == 0) {
+                chain_index[idx / stride] = i;
+            }
+        }
+    }
+    chain_index[0] = primary;
+#pragma omp parallel for schedule(static) if (parts > 1)
+    for (int p = 0; p < parts; ++p) {
+        size_t begin = (size_t)p * span;
+        if (begin < length) {
+            memcpy(output + begin, sa + begin, (begin + span < length ? begin + span : length) - begin);
+        }
+    }
+}
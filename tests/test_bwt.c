@@ -1,6 +1,7 @@
 #include "bwt.h"
 
 #include <assert.h>
+#include <omp.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,6 +45,372 @@ static void test_empty(void) {
     assert(bwt_inverse(&dummy, 0, 0, &dummy) == BWT_STATUS_OK);
 }
 
+// Both forward engines must produce the same transform, and it must invert.
+static void test_engines_random(void) {
+    bwt_config_t sais_cfg;
+    bwt_config_t doubling_cfg;
+    bwt_config_init(&sais_cfg);
+    bwt_config_init(&doubling_cfg);
+    doubling_cfg.engine = BWT_ENGINE_PREFIX_DOUBLING;
+
+    uint8_t data[4096];
+    uint8_t a[4096];
+    uint8_t b[4096];
+    uint8_t decoded[4096];
+    srand(12345);
+    for (int round = 0; round < 300; ++round) {
+        size_t len = 1 + (size_t)rand() % sizeof(data);
+        int alphabet = 1 + rand() % (round % 3 == 0 ? 256 : 4);
+        for (size_t i = 0; i < len; ++i) {
+            data[i] = (uint8_t)(rand() % alphabet);
+        }
+
+        size_t pa = SIZE_MAX;
+        size_t pb = SIZE_MAX;
+        assert(bwt_forward_ex(&sais_cfg, data, len, a, &pa) == BWT_STATUS_OK);
+        assert(bwt_forward_ex(&doubling_cfg, data, len, b, &pb) == BWT_STATUS_OK);
+        assert(pa == pb);
+        assert(memcmp(a, b, len) == 0);
+        assert(bwt_inverse(a, len, pa, decoded) == BWT_STATUS_OK);
+        assert(memcmp(decoded, data, len) == 0);
+    }
+}
+
+// Transforming in place must match the out-of-place transform for every
+// engine, including blocks large enough to be emitted by several threads
+// and data ending in '$', which no longer needs a sentinel.
+static void test_in_place(void) {
+    enum { MAX = 100000 };
+    uint8_t *data = malloc(MAX);
+    uint8_t *expected = malloc(MAX);
+    uint8_t *work = malloc(MAX);
+    uint8_t *decoded = malloc(MAX);
+    assert(data && expected && work && decoded);
+    const size_t lengths[] = { 1, 2, 7, 1024, 1025, 4099, MAX };
+    bwt_context_t ctx;
+    bwt_context_init(&ctx);
+    srand(4242);
+    for (int engine = 0; engine < 2; ++engine) {
+        bwt_config_t cfg;
+        bwt_config_init(&cfg);
+        cfg.engine = engine ? BWT_ENGINE_PREFIX_DOUBLING : BWT_ENGINE_SAIS;
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+            size_t len = lengths[l];
+            for (size_t i = 0; i < len; ++i) {
+                data[i] = (uint8_t)(l % 2 ? rand() : "ab$"[rand() % 3]);
+            }
+            data[len - 1] = '$';
+
+            size_t expected_primary = SIZE_MAX;
+            size_t primary = SIZE_MAX;
+            assert(bwt_forward_ex(&cfg, data, len, expected, &expected_primary) == BWT_STATUS_OK);
+            memcpy(work, data, len);
+            assert(bwt_forward_in_place(&ctx, &cfg, work, len, &primary) == BWT_STATUS_OK);
+            assert(primary == expected_primary && memcmp(work, expected, len) == 0);
+            assert(bwt_inverse(work, len, primary, decoded) == BWT_STATUS_OK);
+            assert(memcmp(decoded, data, len) == 0);
+
+            size_t chain_index[BWT_MAX_CHAINS];
+            memcpy(work, data, len);
+            assert(bwt_forward_chains_ctx(NULL, &cfg, work, len, work, chain_index, 16) == BWT_STATUS_OK);
+            assert(memcmp(work, expected, len) == 0);
+            assert(bwt_inverse_chains(&cfg, work, len, chain_index, bwt_chain_count(len, 16), decoded) == BWT_STATUS_OK);
+            assert(memcmp(decoded, data, len) == 0);
+        }
+    }
+    bwt_context_free(&ctx);
+    free(data);
+    free(expected);
+    free(work);
+    free(decoded);
+}
+
+// Every inverse layout must rebuild the block, and the sampled one must
+// stay within the budget it was given.
+static void test_inverse_memory(void) {
+    enum { MAX = 70000 };
+    uint8_t *data = malloc(MAX);
+    uint8_t *encoded = malloc(MAX);
+    uint8_t *decoded = malloc(MAX);
+    assert(data && encoded && decoded);
+    const size_t lengths[] = { 1, 2, 255, 256, 257, 4096, 33333, MAX };
+    bwt_context_t ctx;
+    bwt_context_init(&ctx);
+    srand(777);
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+        size_t len = lengths[l];
+        for (size_t i = 0; i < len; ++i) {
+            data[i] = (uint8_t)(l % 2 ? rand() : "acgt"[rand() % 4]);
+        }
+        bwt_config_t cfg;
+        bwt_config_init(&cfg);
+        size_t chain_index[BWT_MAX_CHAINS];
+        assert(bwt_forward_chains(&cfg, data, len, encoded, chain_index, 16) == BWT_STATUS_OK);
+        size_t chains = bwt_chain_count(len, 16);
+
+        const size_t budgets[] = { 0, 4 * len, 4 * len - 1, len, len / 4, 1 };
+        for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); ++b) {
+            cfg.inverse_memory = budgets[b];
+            size_t bytes = bwt_inverse_workspace_bytes(&cfg, len);
+            assert(budgets[b] == 0 || bytes <= budgets[b] || budgets[b] < len / 64 + 1024);
+            memset(decoded, 0, len);
+            assert(bwt_inverse_chains_ctx(&ctx, &cfg, encoded, len, chain_index, chains, decoded) == BWT_STATUS_OK);
+            assert(memcmp(decoded, data, len) == 0);
+            memset(decoded, 0, len);
+            assert(bwt_inverse_chains(&cfg, encoded, len, chain_index, 1, decoded) == BWT_STATUS_OK);
+            assert(memcmp(decoded, data, len) == 0);
+        }
+    }
+    bwt_context_free(&ctx);
+    free(data);
+    free(encoded);
+    free(decoded);
+}
+
+// Past 2^24 rows the packed inverse needs 8 bytes per row; a 4-byte cap
+// per row selects the 32-bit LF table instead.
+static void test_inverse_lf32(void) {
+    size_t len = ((size_t)1 << 24) + 4097;
+    uint8_t *data = malloc(len);
+    uint8_t *encoded = malloc(len);
+    uint8_t *decoded = malloc(len);
+    assert(data && encoded && decoded);
+    uint32_t state = 1;
+    for (size_t i = 0; i < len; ++i) {
+        state = state * 1103515245u + 12345u;
+        data[i] = (uint8_t)(state >> 28);
+    }
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+    size_t chain_index[BWT_MAX_CHAINS];
+    assert(bwt_forward_chains(&cfg, data, len, encoded, chain_index, 16) == BWT_STATUS_OK);
+    assert(bwt_inverse_workspace_bytes(&cfg, len) == 8 * len);
+    cfg.inverse_memory = 4 * len;
+    assert(bwt_inverse_workspace_bytes(&cfg, len) == 4 * len);
+    assert(bwt_inverse_chains(&cfg, encoded, len, chain_index, bwt_chain_count(len, 16), decoded) == BWT_STATUS_OK);
+    assert(memcmp(decoded, data, len) == 0);
+    free(data);
+    free(encoded);
+    free(decoded);
+}
+
+// A transform's team size comes from cfg->threads and must not leak into
+// the caller's OpenMP default; the result never depends on it.
+static void test_threads(void) {
+    enum { LEN = 50000 };
+    uint8_t *data = malloc(LEN);
+    uint8_t *expected = malloc(LEN);
+    uint8_t *encoded = malloc(LEN);
+    uint8_t *decoded = malloc(LEN);
+    assert(data && expected && encoded && decoded);
+    for (size_t i = 0; i < LEN; ++i) {
+        data[i] = (uint8_t)("banana bandana "[i % 15] + (i % 997 == 0));
+    }
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+    size_t expected_index[BWT_MAX_CHAINS];
+    size_t chain_index[BWT_MAX_CHAINS];
+    cfg.threads = 1;
+    assert(bwt_forward_chains(&cfg, data, LEN, expected, expected_index, 16) == BWT_STATUS_OK);
+
+    int default_threads = omp_get_max_threads();
+    const int teams[] = { 2, 3, 8 };
+    for (int e = 0; e < 2; ++e) {
+        cfg.engine = e ? BWT_ENGINE_PREFIX_DOUBLING : BWT_ENGINE_SAIS;
+        for (size_t t = 0; t < sizeof(teams) / sizeof(teams[0]); ++t) {
+            cfg.threads = teams[t];
+            assert(bwt_forward_chains(&cfg, data, LEN, encoded, chain_index, 16) == BWT_STATUS_OK);
+            assert(memcmp(encoded, expected, LEN) == 0);
+            assert(memcmp(chain_index, expected_index, bwt_chain_count(LEN, 16) * sizeof(size_t)) == 0);
+            assert(bwt_inverse_chains(&cfg, encoded, LEN, chain_index, bwt_chain_count(LEN, 16), decoded) == BWT_STATUS_OK);
+            assert(memcmp(decoded, data, LEN) == 0);
+            assert(omp_get_max_threads() == default_threads);
+        }
+    }
+    free(data);
+    free(expected);
+    free(encoded);
+    free(decoded);
+}
+
+// Blocks under 4 GiB use 32-bit indices: SA-IS needs a little over 4 bytes per byte.
+static void test_workspace_compact(void) {
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+    size_t len = (size_t)1 << 20;
+    assert(bwt_forward_workspace_bytes(&cfg, 0) == 0);
+    assert(bwt_forward_workspace_bytes(&cfg, len) < 5 * len);
+    cfg.engine = BWT_ENGINE_PREFIX_DOUBLING;
+    assert(bwt_forward_workspace_bytes(&cfg, len) < 17 * len);
+}
+
+// Several LF chains per block must rebuild the same data as a single chain.
+static void test_chains_random(void) {
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+
+    static uint8_t data[70000];
+    static uint8_t encoded[70000];
+    static uint8_t decoded[70000];
+    size_t chain_index[BWT_MAX_CHAINS];
+    const size_t lengths[] = { 1, 2, 3, 15, 16, 17, 33, 1000, 4097, sizeof(data) };
+    const size_t chain_counts[] = { 1, 2, 3, 8, 16, 100, BWT_MAX_CHAINS };
+    srand(777);
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+        size_t len = lengths[l];
+        for (size_t i = 0; i < len; ++i) {
+            data[i] = (uint8_t)(l % 2 ? rand() % 3 : rand());
+        }
+        for (size_t c = 0; c < sizeof(chain_counts) / sizeof(chain_counts[0]); ++c) {
+            size_t chains = bwt_chain_count(len, chain_counts[c]);
+            assert(chains >= 1 && chains <= chain_counts[c]);
+            assert(bwt_forward_chains(&cfg, data, len, encoded, chain_index, chain_counts[c]) == BWT_STATUS_OK);
+            memset(decoded, 0, len);
+            assert(bwt_inverse_chains(&cfg, encoded, len, chain_index, chains, decoded) == BWT_STATUS_OK);
+            assert(memcmp(decoded, data, len) == 0);
+        }
+    }
+}
+
+// One context serves blocks of any size and engine; its workspace only grows.
+static void test_context_reuse(void) {
+    static uint8_t data[70000];
+    static uint8_t encoded[70000];
+    static uint8_t decoded[70000];
+    size_t chain_index[BWT_MAX_CHAINS];
+    const size_t lengths[] = { 70000, 5, 1000, 65536, 2, 70000 };
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+    bwt_context_t ctx;
+    bwt_context_init(&ctx);
+    assert(bwt_context_high_water(&ctx) == 0);
+    srand(4242);
+
+    size_t previous = 0;
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+        size_t len = lengths[l];
+        cfg.engine = (l % 2) ? BWT_ENGINE_PREFIX_DOUBLING : BWT_ENGINE_SAIS;
+        for (size_t i = 0; i < len; ++i) {
+            data[i] = (uint8_t)(rand() % (l % 3 ? 4 : 256));
+        }
+        size_t chains = bwt_chain_count(len, cfg.chains);
+        assert(bwt_forward_chains_ctx(&ctx, &cfg, data, len, encoded, chain_index, cfg.chains) == BWT_STATUS_OK);
+        assert(bwt_inverse_chains_ctx(&ctx, &cfg, encoded, len, chain_index, chains, decoded) == BWT_STATUS_OK);
+        assert(memcmp(decoded, data, len) == 0);
+        assert(bwt_context_high_water(&ctx) >= previous);
+        previous = bwt_context_high_water(&ctx);
+    }
+    assert(previous >= bwt_forward_workspace_bytes(&cfg, 70000));
+    bwt_context_free(&ctx);
+    assert(bwt_context_high_water(&ctx) == 0);
+}
+
+// In-memory source and sink for the stream API; blocks are framed as [len][primary][bytes].
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    size_t pos;
+    uint8_t *out;
+    size_t out_len;
+    size_t blocks;
+} mem_stream_t;
+
+static size_t mem_read(void *user_ctx, uint8_t *buffer, size_t max_len) {
+    mem_stream_t *s = user_ctx;
+    size_t n = s->length - s->pos < max_len ? s->length - s->pos : max_len;
+    memcpy(buffer, s->data + s->pos, n);
+    s->pos += n;
+    return n;
+}
+
+static size_t mem_read_block(void *user_ctx, uint8_t *buffer, size_t max_len, size_t *primary_index) {
+    mem_stream_t *s = user_ctx;
+    if (s->pos == s->length) {
+        return 0;
+    }
+    size_t len;
+    memcpy(&len, s->data + s->pos, sizeof(len));
+    memcpy(primary_index, s->data + s->pos + sizeof(len), sizeof(*primary_index));
+    s->pos += sizeof(len) + sizeof(*primary_index);
+    assert(len <= max_len);
+    memcpy(buffer, s->data + s->pos, len);
+    s->pos += len;
+    return len;
+}
+
+static int mem_write_block(void *user_ctx, const uint8_t *buffer, size_t length, size_t primary_index) {
+    mem_stream_t *s = user_ctx;
+    memcpy(s->out + s->out_len, &length, sizeof(length));
+    memcpy(s->out + s->out_len + sizeof(length), &primary_index, sizeof(primary_index));
+    s->out_len += sizeof(length) + sizeof(primary_index);
+    memcpy(s->out + s->out_len, buffer, length);
+    s->out_len += length;
+    s->blocks++;
+    return 0;
+}
+
+static int mem_write(void *user_ctx, const uint8_t *buffer, size_t length, size_t primary_index) {
+    (void)primary_index;
+    mem_stream_t *s = user_ctx;
+    memcpy(s->out + s->out_len, buffer, length);
+    s->out_len += length;
+    return 0;
+}
+
+static int mem_write_fail(void *user_ctx, const uint8_t *buffer, size_t length, size_t primary_index) {
+    (void)buffer;
+    (void)length;
+    (void)primary_index;
+    mem_stream_t *s = user_ctx;
+    return ++s->blocks == 3 ? -1 : 0;
+}
+
+// The pipelined stream matches the sequential one block for block, and stops on a failed write.
+static void test_stream_in_flight(void) {
+    enum { LEN = 300000, BLOCK = 4096 };
+    uint8_t *data = malloc(LEN);
+    uint8_t *framed[2] = { malloc(LEN + 2048), malloc(LEN + 2048) };
+    uint8_t *decoded = malloc(LEN);
+    assert(data && framed[0] && framed[1] && decoded);
+    srand(777);
+    for (size_t i = 0; i < LEN; ++i) {
+        data[i] = (uint8_t)(rand() % 5);
+    }
+
+    bwt_config_t defaults;
+    bwt_config_init(&defaults);
+    assert(defaults.in_flight == 1); // callbacks stay on the caller unless it opts in
+
+    const size_t in_flight[] = { 1, 4 };
+    size_t framed_len[2];
+    for (size_t r = 0; r < 2; ++r) {
+        bwt_config_t cfg;
+        bwt_config_init(&cfg);
+        cfg.block_size = BLOCK;
+        cfg.in_flight = in_flight[r];
+
+        mem_stream_t fwd = { data, LEN, 0, framed[r], 0, 0 };
+        assert(bwt_forward_stream(&cfg, mem_read, &fwd, mem_write_block, &fwd) == BWT_STATUS_OK);
+        assert(fwd.blocks == (LEN + BLOCK - 1) / BLOCK);
+        framed_len[r] = fwd.out_len;
+
+        mem_stream_t inv = { framed[r], fwd.out_len, 0, decoded, 0, 0 };
+        assert(bwt_inverse_stream(&cfg, mem_read_block, &inv, mem_write, &inv) == BWT_STATUS_OK);
+        assert(inv.out_len == LEN && memcmp(decoded, data, LEN) == 0);
+
+        mem_stream_t fail = { data, LEN, 0, NULL, 0, 0 };
+        assert(bwt_forward_stream(&cfg, mem_read, &fail, mem_write_fail, &fail) == BWT_STATUS_INTERNAL_ERROR);
+        assert(fail.blocks == 3);
+    }
+    assert(framed_len[0] == framed_len[1] && memcmp(framed[0], framed[1], framed_len[0]) == 0);
+
+    free(data);
+    free(framed[0]);
+    free(framed[1]);
+    free(decoded);
+}
+
 int main(void) {
     const uint8_t banana[] = { 'b','a','n','a','n','a','$' };
     const uint8_t mississippi[] = { 'm','i','s','s','i','s','s','i','p','p','i' };
@@ -58,6 +425,15 @@ int main(void) {
     test_roundtrip_alloc(banana, sizeof(banana));
     test_roundtrip_alloc(abracadabra, sizeof(abracadabra));
     test_empty();
+    test_engines_random();
+    test_in_place();
+    test_inverse_memory();
+    test_inverse_lf32();
+    test_threads();
+    test_workspace_compact();
+    test_chains_random();
+    test_context_reuse();
+    test_stream_in_flight();
     puts("BWT tests passed.");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+#include "crc32c.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(void) {
+    // Standard check value for CRC-32C
+    assert(crc32c_update(0, (const uint8_t *)"123456789", 9) == 0xE3069283u);
+    assert(crc32c_update(0, NULL, 0) == 0);
+
+    // Hashing in pieces matches hashing in one call, for every split alignment
+    enum { LEN = 4099 };
+    static uint8_t data[LEN];
+    srand(3);
+    for (size_t i = 0; i < LEN; ++i) {
+        data[i] = (uint8_t)rand();
+    }
+    uint32_t whole = crc32c_update(0, data, LEN);
+    for (size_t split = 0; split < 64; ++split) {
+        uint32_t crc = crc32c_update(0, data, split);
+        crc = crc32c_update(crc, data + split, LEN - split);
+        assert(crc == whole);
+    }
+
+    puts("CRC32C tests passed.");
+    return 0;
+}
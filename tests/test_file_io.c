@@ -0,0 +1,71 @@
+#include "file_io.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum { FILES = 40, READS = FILES + 3 };
+
+static char paths[FILES][64];
+static uint8_t contents[FILES][5000];
+static size_t sizes[FILES];
+
+static void make_files(void) {
+    srand(99);
+    for (int f = 0; f < FILES; ++f) {
+        snprintf(paths[f], sizeof(paths[f]), "/tmp/test_file_io_%d_%d", (int)getpid(), f);
+        sizes[f] = (size_t)(f * 123) % sizeof(contents[f]);
+        for (size_t i = 0; i < sizes[f]; ++i) {
+            contents[f][i] = (uint8_t)rand();
+        }
+        FILE *file = fopen(paths[f], "wb");
+        assert(file && fwrite(contents[f], 1, sizes[f], file) == sizes[f]);
+        fclose(file);
+    }
+}
+
+// Every backend reads whole files, ranges through an open descriptor, and
+// reports files that are missing or shorter than asked
+static void test_backend(io_backend_t backend, unsigned depth) {
+    static uint8_t buffers[READS][5000];
+    io_read_t reads[READS];
+    memset(buffers, 0, sizeof(buffers));
+    for (int f = 0; f < FILES; ++f) {
+        reads[f] = (io_read_t){ paths[f], -1, buffers[f], sizes[f], 0, 7 };
+    }
+    int fd = open(paths[FILES - 1], O_RDONLY);
+    assert(fd >= 0);
+    reads[FILES] = (io_read_t){ paths[FILES - 1], fd, buffers[FILES], 100, 50, 7 };
+    reads[FILES + 1] = (io_read_t){ "/tmp/test_file_io_missing", -1, buffers[FILES + 1], 10, 0, 7 };
+    reads[FILES + 2] = (io_read_t){ paths[3], -1, buffers[FILES + 2], sizes[3] + 1, 0, 7 };
+
+    io_backend_t used = io_read_batch(reads, READS, depth, backend);
+    assert(backend == IO_BACKEND_AUTO || backend == used || (backend == IO_BACKEND_URING && used == IO_BACKEND_THREADS));
+
+    for (int f = 0; f < FILES; ++f) {
+        assert(reads[f].result == 1);
+        assert(memcmp(buffers[f], contents[f], sizes[f]) == 0);
+    }
+    assert(reads[FILES].result == 1 && memcmp(buffers[FILES], contents[FILES - 1] + 50, 100) == 0);
+    assert(reads[FILES + 1].result == -1);
+    assert(reads[FILES + 2].result == 0);
+    close(fd);
+}
+
+int main(void) {
+    make_files();
+    test_backend(IO_BACKEND_SYNC, 1);
+    test_backend(IO_BACKEND_THREADS, 8);
+    test_backend(IO_BACKEND_URING, 8);
+    test_backend(IO_BACKEND_AUTO, 64);
+    test_backend(IO_BACKEND_AUTO, 0);
+    for (int f = 0; f < FILES; ++f) {
+        unlink(paths[f]);
+    }
+    puts("File I/O tests passed.");
+    return 0;
+}
@@ -0,0 +1,585 @@
+#define _XOPEN_SOURCE 700 // nftw
+
+#include "file_manager.h"
+#include "pipeline.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdarg.h>
+#include <omp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char root[64];
+
+static void path_of(char *path, size_t size, const char *name) {
+    snprintf(path, size, "%s/%s", root, name);
+}
+
+static void write_file(const char *name, const uint8_t *data, size_t len) {
+    char path[256];
+    path_of(path, sizeof(path), name);
+    for (char *slash = strchr(path + strlen(root) + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+    FILE *file = fopen(path, "wb");
+    assert(file && fwrite(data, 1, len, file) == len);
+    fclose(file);
+}
+
+static void check_file(const char *name, const uint8_t *data, size_t len) {
+    char path[256];
+    path_of(path, sizeof(path), name);
+    FILE *file = fopen(path, "rb");
+    assert(file);
+    uint8_t *read = malloc(len + 1);
+    assert(read && fread(read, 1, len + 1, file) == len);
+    assert(memcmp(read, data, len) == 0);
+    free(read);
+    fclose(file);
+}
+
+static int remove_path(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+// Leaves garbage where the callee frames of the next fm_* call will live
+static void dirty_stack(void) {
+    volatile uint8_t junk[64 * 1024];
+    for (size_t i = 0; i < sizeof(junk); ++i) {
+        junk[i] = 0x41;
+    }
+}
+
+// fm_compress and fm_decompress run on the defaults from fm_config_init
+static void test_default_config(const uint8_t *text, size_t len) {
+    char input[256];
+    char archive[256];
+    char output[256];
+    write_file("default/in/a.txt", text, len);
+    write_file("default/in/sub/b.txt", text + 1, len - 1);
+    path_of(input, sizeof(input), "default/in");
+    path_of(archive, sizeof(archive), "default/a.w");
+    path_of(output, sizeof(output), "default/out");
+
+    dirty_stack();
+    assert(fm_compress(input, archive) == FM_STATUS_OK);
+    dirty_stack();
+    assert(fm_decompress(archive, output) == FM_STATUS_OK);
+    check_file("default/out/a.txt", text, len);
+    check_file("default/out/sub/b.txt", text + 1, len - 1);
+}
+
+// Flips one byte of the file
+static void corrupt_byte(const char *name, long offset_from_end) {
+    char path[256];
+    path_of(path, sizeof(path), name);
+    FILE *file = fopen(path, "r+b");
+    assert(file && fseek(file, -offset_from_end, SEEK_END) == 0);
+    int c = fgetc(file);
+    assert(c != EOF && fseek(file, -offset_from_end, SEEK_END) == 0);
+    fputc(c ^ 0xff, file);
+    fclose(file);
+}
+
+// Multi-block entries round-trip, and single entries are found through
+// the central directory, which is checked before it is trusted
+static void test_container(const uint8_t *text, size_t len) {
+    char input[256];
+    char archive[256];
+    char output[256];
+    write_file("container/in/a.txt", text, len);
+    write_file("container/in/conf/app.ini", text + 100, 5000);
+    write_file("container/in/empty", text, 0);
+    path_of(input, sizeof(input), "container/in");
+    path_of(archive, sizeof(archive), "container/a.w");
+    path_of(output, sizeof(output), "container/out");
+
+    fm_config_t cfg;
+    fm_config_init(&cfg);
+    cfg.bwt.block_size = 64 * 1024;
+    cfg.solid_max_file = 0;
+    cfg.dedup = 0;
+    assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+    assert(fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK);
+    check_file("container/out/a.txt", text, len);
+    check_file("container/out/conf/app.ini", text + 100, 5000);
+    check_file("container/out/empty", text, 0);
+
+    path_of(output, sizeof(output), "container/one");
+    assert(fm_extract_one(archive, "./conf/app.ini", output, &cfg) == FM_STATUS_OK);
+    check_file("container/one/conf/app.ini", text + 100, 5000);
+    assert(fm_extract_one(archive, "a.txt", output, &cfg) == FM_STATUS_OK);
+    check_file("container/one/a.txt", text, len);
+    assert(fm_extract_one(archive, "conf/missing.ini", output, &cfg) == FM_STATUS_FILE_NOT_FOUND);
+
+    // The last directory byte, just before the footer
+    corrupt_byte("container/a.w", 2 * sizeof(uint64_t) + 4 + sizeof(uint32_t) + 1);
+    assert(fm_extract_one(archive, "a.txt", output, &cfg) == FM_STATUS_ERROR);
+}
+
+// Small files share solid blocks and each can still be extracted alone
+static void test_solid(const uint8_t *text, size_t len) {
+    enum { FILES = 300 };
+    static const char *extensions[] = { "c", "h", "txt", "json" };
+    char name[64];
+    char input[256];
+    char archive[256];
+    char output[256];
+    for (int f = 0; f < FILES; ++f) {
+        snprintf(name, sizeof(name), "solid/in/d%d/f%d.%s", f % 7, f, extensions[f % 4]);
+        write_file(name, text + f * 37 % (len / 2), (size_t)(f * 131) % 3000);
+    }
+    path_of(input, sizeof(input), "solid/in");
+    path_of(archive, sizeof(archive), "solid/a.w");
+    path_of(output, sizeof(output), "solid/out");
+
+    fm_config_t cfg;
+    fm_config_init(&cfg);
+    cfg.bwt.block_size = 64 * 1024;
+    cfg.dedup = 0;
+    fm_stats_t stats;
+    cfg.stats = &stats;
+    assert(cfg.solid_max_file > 3000);
+    assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+    assert(stats.files == FILES && stats.blocks > 1 && stats.blocks < FILES / 10);
+    assert(fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK);
+    for (int f = 0; f < FILES; ++f) {
+        snprintf(name, sizeof(name), "solid/out/d%d/f%d.%s", f % 7, f, extensions[f % 4]);
+        check_file(name, text + f * 37 % (len / 2), (size_t)(f * 131) % 3000);
+    }
+
+    path_of(output, sizeof(output), "solid/one");
+    for (int f = 1; f < FILES; f += 149) {
+        snprintf(name, sizeof(name), "d%d/f%d.%s", f % 7, f, extensions[f % 4]);
+        assert(fm_extract_one(archive, name, output, &cfg) == FM_STATUS_OK);
+        snprintf(name, sizeof(name), "solid/one/d%d/f%d.%s", f % 7, f, extensions[f % 4]);
+        check_file(name, text + f * 37 % (len / 2), (size_t)(f * 131) % 3000);
+    }
+}
+
+// Identical files are stored once; the copies are links that extract on
+// their own, from a plain entry or a solid member
+static void test_dedup(const uint8_t *text, size_t len) {
+    static const char *copies[] = { "big.txt", "sub/big copy.txt", "z/big.txt" };
+    static const char *small_copies[] = { "s1.ini", "sub/s2.ini" };
+    char name[64];
+    char input[256];
+    char archive[256];
+    char output[256];
+    uint8_t *other = malloc(3000);
+    assert(other);
+    memcpy(other, text + 5000, 3000);
+    other[1500] ^= 1; // same size and nearly the same bytes as the small copies
+    for (int c = 0; c < 3; ++c) {
+        snprintf(name, sizeof(name), "dedup/in/%s", copies[c]);
+        write_file(name, text, len);
+    }
+    for (int c = 0; c < 2; ++c) {
+        snprintf(name, sizeof(name), "dedup/in/%s", small_copies[c]);
+        write_file(name, text + 5000, 3000);
+    }
+    write_file("dedup/in/other.ini", other, 3000);
+    write_file("dedup/in/pad.ini", text + 9000, 2000); // a solid block needs company
+    path_of(input, sizeof(input), "dedup/in");
+    path_of(archive, sizeof(archive), "dedup/a.w");
+    path_of(output, sizeof(output), "dedup/out");
+
+    fm_config_t cfg;
+    fm_config_init(&cfg);
+    fm_stats_t stats;
+    cfg.stats = &stats;
+    assert(cfg.dedup);
+    assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+    assert(stats.files == 7 && stats.original_bytes == len + 3000 + 3000 + 2000);
+    assert(fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK);
+    for (int c = 0; c < 3; ++c) {
+        snprintf(name, sizeof(name), "dedup/out/%s", copies[c]);
+        check_file(name, text, len);
+    }
+    for (int c = 0; c < 2; ++c) {
+        snprintf(name, sizeof(name), "dedup/out/%s", small_copies[c]);
+        check_file(name, text + 5000, 3000);
+    }
+    check_file("dedup/out/other.ini", other, 3000);
+
+    // Whichever copy was kept, every name extracts alone
+    for (int c = 0; c < 3; ++c) {
+        snprintf(name, sizeof(name), "dedup/one%d", c);
+        path_of(output, sizeof(output), name);
+        assert(fm_extract_one(archive, copies[c], output, &cfg) == FM_STATUS_OK);
+        snprintf(name, sizeof(name), "dedup/one%d/%s", c, copies[c]);
+        check_file(name, text, len);
+    }
+    for (int c = 0; c < 2; ++c) {
+        snprintf(name, sizeof(name), "dedup/small%d", c);
+        path_of(output, sizeof(output), name);
+        assert(fm_extract_one(archive, small_copies[c], output, &cfg) == FM_STATUS_OK);
+        snprintf(name, sizeof(name), "dedup/small%d/%s", c, small_copies[c]);
+        check_file(name, text + 5000, 3000);
+    }
+    free(other);
+}
+
+// Calls split their threads between blocks without touching the
+// process-wide nesting setting, so concurrent calls cannot disturb it
+static void test_threads(const uint8_t *text, size_t len) {
+    char input[256];
+    char archive[256];
+    char output[256];
+    write_file("threads/in/a.txt", text, len);
+    path_of(input, sizeof(input), "threads/in/a.txt");
+    path_of(archive, sizeof(archive), "threads/a.w");
+    path_of(output, sizeof(output), "threads/out");
+
+    int levels = omp_get_max_active_levels();
+    fm_config_t cfg;
+    fm_config_init(&cfg);
+    cfg.bwt.block_size = len / 2 + 1;
+    for (int threads = 1; threads <= 5; threads += 2) {
+        cfg.bwt.threads = threads;
+        assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+        assert(fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK);
+        check_file("threads/out/a.txt", text, len);
+        assert(omp_get_max_active_levels() == levels);
+    }
+}
+
+// Spans of large files that the scan keeps from the BWT become wider blocks;
+// text keeps the configured size, and so does everything with adaptive off
+static void test_adaptive_blocks(const uint8_t *text) {
+    enum { BLOCK = 64 * 1024, LEN = 16 * BLOCK };
+    uint8_t *noise = malloc(LEN);
+    assert(noise);
+    srand(7);
+    for (size_t i = 0; i < LEN; ++i) {
+        noise[i] = (uint8_t)rand();
+    }
+    write_file("adaptive/noise.bin", noise, LEN);
+    write_file("adaptive/text.txt", text, 4 * BLOCK + 1000); // mapped, like noise.bin
+    char input[256];
+    char archive[256];
+    char output[256];
+    path_of(archive, sizeof(archive), "adaptive/a.w");
+    path_of(output, sizeof(output), "adaptive/out");
+
+    fm_config_t cfg;
+    fm_config_init(&cfg);
+    fm_stats_t stats;
+    cfg.stats = &stats;
+    cfg.bwt.block_size = BLOCK;
+    path_of(input, sizeof(input), "adaptive/noise.bin");
+    assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+    assert(stats.blocks > 1 && stats.blocks < LEN / BLOCK && stats.stored_blocks == stats.blocks);
+    assert(fm_extract_one(archive, "noise.bin", output, &cfg) == FM_STATUS_OK);
+    check_file("adaptive/out/noise.bin", noise, LEN);
+
+    path_of(input, sizeof(input), "adaptive/text.txt");
+    assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+    assert(stats.blocks == 5 && stats.stored_blocks == 0);
+
+    cfg.adaptive = 0;
+    path_of(input, sizeof(input), "adaptive/noise.bin");
+    assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+    assert(stats.blocks == LEN / BLOCK && stats.stored_blocks == 0);
+    assert(fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK);
+    check_file("adaptive/out/noise.bin", noise, LEN);
+    free(noise);
+}
+
+// Files the next open() truncates first, as if they shrank after the scan
+static struct {
+    char path[256];
+    off_t size;
+} shrinking[4];
+
+// Stands in for libc's open() in the library's calls; openat does the work
+int open(const char *path, int flags, ...) {
+    mode_t mode = 0;
+    if (flags & O_CREAT) {
+        va_list args;
+        va_start(args, flags);
+        mode = (mode_t)va_arg(args, int);
+        va_end(args);
+    }
+    for (size_t i = 0; i < sizeof(shrinking) / sizeof(shrinking[0]); ++i) {
+        if (shrinking[i].path[0] && strcmp(path, shrinking[i].path) == 0) {
+            assert(truncate(path, shrinking[i].size) == 0);
+            shrinking[i].path[0] = '\0';
+        }
+    }
+    return openat(AT_FDCWD, path, flags, mode);
+}
+
+static void shrink_on_open(int slot, const char *name, off_t size) {
+    path_of(shrinking[slot].path, sizeof(shrinking[slot].path), name);
+    shrinking[slot].size = size;
+}
+
+// Files that shrink between the scan and the read keep what they still hold,
+// mapped or read, whole entries or solid members, and the archive completes
+static void test_shrinking_files(const uint8_t *text, size_t len) {
+    char name[64];
+    char input[256];
+    char archive[256];
+    char output[256];
+    write_file("shrink/in/mapped.txt", text, len);
+    write_file("shrink/in/emptied.txt", text, len);
+    write_file("shrink/in/read.txt", text, 200000);
+    for (int f = 0; f < 3; ++f) {
+        snprintf(name, sizeof(name), "shrink/in/s%d.ini", f);
+        write_file(name, text + f, 3000 + f);
+    }
+    shrink_on_open(0, "shrink/in/mapped.txt", 100000);
+    shrink_on_open(1, "shrink/in/emptied.txt", 0);
+    shrink_on_open(2, "shrink/in/read.txt", 70000);
+    shrink_on_open(3, "shrink/in/s1.ini", 1000);
+    path_of(input, sizeof(input), "shrink/in");
+    path_of(archive, sizeof(archive), "shrink/a.w");
+    path_of(output, sizeof(output), "shrink/out");
+
+    fm_config_t cfg;
+    fm_config_init(&cfg);
+    cfg.bwt.block_size = 64 * 1024;
+    cfg.dedup = 0;
+    cfg.io_backend = IO_BACKEND_THREADS; // io_uring would open the files without open()
+    assert(len > 256 * 1024 && 200000 > cfg.solid_max_file);
+    assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+    for (size_t i = 0; i < sizeof(shrinking) / sizeof(shrinking[0]); ++i) {
+        assert(shrinking[i].path[0] == '\0');
+    }
+    assert(fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK);
+    check_file("shrink/out/mapped.txt", text, 100000);
+    check_file("shrink/out/emptied.txt", text, 0);
+    check_file("shrink/out/read.txt", text, 70000);
+    check_file("shrink/out/s0.ini", text, 3000);
+    check_file("shrink/out/s1.ini", text + 1, 1000);
+    check_file("shrink/out/s2.ini", text + 2, 3002);
+
+    path_of(output, sizeof(output), "shrink/one");
+    assert(fm_extract_one(archive, "s2.ini", output, &cfg) == FM_STATUS_OK);
+    check_file("shrink/one/s2.ini", text + 2, 3002);
+}
+
+static size_t read_stream(void *user_ctx, uint8_t *buffer, size_t max_len) {
+    return fread(buffer, 1, max_len, (FILE *)user_ctx);
+}
+
+// Hands out a buffer a few bytes at a time, as a pipe may
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+} chunked_t;
+
+static size_t read_chunks(void *user_ctx, uint8_t *buffer, size_t max_len) {
+    chunked_t *in = user_ctx;
+    size_t n = in->len - in->pos;
+    n = n < max_len ? n : max_len;
+    n = n < 7919 ? n : 7919;
+    memcpy(buffer, in->data + in->pos, n);
+    in->pos += n;
+    return n;
+}
+
+// The single entry of a streamed archive extracts whole and alone
+static void check_stream(const char *archive, const char *entry, const uint8_t *data, size_t len,
+                         const fm_config_t *cfg) {
+    char output[256];
+    char name[128];
+    path_of(output, sizeof(output), "stream/out");
+    assert(fm_decompress_ex(archive, output, cfg) == FM_STATUS_OK);
+    snprintf(name, sizeof(name), "stream/out/%s", entry);
+    check_file(name, data, len);
+    path_of(output, sizeof(output), "stream/one");
+    assert(fm_extract_one(archive, entry, output, cfg) == FM_STATUS_OK);
+    snprintf(name, sizeof(name), "stream/one/%s", entry);
+    check_file(name, data, len);
+}
+
+// Input of unknown length is cut into blocks as it arrives: several full
+// blocks, a partial last one, an exact multiple, nothing at all, and stdin
+static void test_stream(const uint8_t *text, size_t len) {
+    enum { BLOCK = 64 * 1024 };
+    char archive[256];
+    write_file("stream/.keep", text, 0); // creates the directory the archives go in
+    path_of(archive, sizeof(archive), "stream/a.w");
+
+    fm_config_t cfg;
+    fm_config_init(&cfg);
+    fm_stats_t stats;
+    cfg.stats = &stats;
+    cfg.bwt.block_size = BLOCK;
+    const size_t sizes[] = { 4 * BLOCK + 123, 3 * BLOCK, 1 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        assert(sizes[i] <= len);
+        FILE *in = fmemopen((void *)text, sizes[i], "rb");
+        assert(in);
+        assert(fm_compress_stream(read_stream, in, "piped.txt", archive, &cfg) == FM_STATUS_OK);
+        fclose(in);
+        assert(stats.files == 1 && stats.blocks == (sizes[i] + BLOCK - 1) / BLOCK);
+        check_stream(archive, "piped.txt", text, sizes[i], &cfg);
+    }
+
+    chunked_t chunks = { text, len, 0 };
+    assert(fm_compress_stream(read_chunks, &chunks, "chunks.txt", archive, &cfg) == FM_STATUS_OK);
+    check_stream(archive, "chunks.txt", text, len, &cfg);
+    chunks = (chunked_t){ text, 0, 0 };
+    assert(fm_compress_stream(read_chunks, &chunks, "empty", archive, &cfg) == FM_STATUS_OK);
+    assert(stats.files == 1 && stats.blocks == 0);
+    check_stream(archive, "empty", text, 0, &cfg);
+
+    // "-" reads standard input, here a pipe another process writes into
+    int fds[2];
+    assert(pipe(fds) == 0);
+    pid_t child = fork();
+    assert(child >= 0);
+    if (child == 0) {
+        close(fds[0]);
+        for (size_t done = 0; done < len;) {
+            ssize_t n = write(fds[1], text + done, len - done < 5000 ? len - done : 5000);
+            if (n <= 0) {
+                _exit(1);
+            }
+            done += (size_t)n;
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    int saved_stdin = dup(STDIN_FILENO);
+    assert(saved_stdin >= 0 && dup2(fds[0], STDIN_FILENO) >= 0);
+    close(fds[0]);
+    assert(fm_compress_ex("-", archive, &cfg) == FM_STATUS_OK);
+    int child_status = 0;
+    assert(waitpid(child, &child_status, 0) == child && WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0);
+    assert(dup2(saved_stdin, STDIN_FILENO) >= 0);
+    close(saved_stdin);
+    clearerr(stdin);
+    check_stream(archive, FM_STDIN_ENTRY, text, len, &cfg);
+}
+
+static void write_text(const char *name, const char *content) {
+    write_file(name, (const uint8_t *)content, strlen(content));
+}
+
+// The cgroup's own memory.max or a tighter one above it; "max" sets no limit
+static void test_cgroup_limit(void) {
+    char proc[256];
+    char hierarchy[256];
+    path_of(proc, sizeof(proc), "cgroup/proc");
+    path_of(hierarchy, sizeof(hierarchy), "cgroup/sys");
+    write_text("cgroup/proc", "1:name=systemd:/elsewhere\n0::/a/b\n");
+    write_text("cgroup/sys/a/memory.max", "268435456\n");
+    write_text("cgroup/sys/a/b/memory.max", "max\n");
+    assert(fm_cgroup_memory_max(proc, hierarchy) == 268435456u);
+
+    write_text("cgroup/sys/a/b/memory.max", "1048576\n");
+    assert(fm_cgroup_memory_max(proc, hierarchy) == 1048576u);
+
+    write_text("cgroup/sys/a/memory.max", "max\n");
+    write_text("cgroup/sys/a/b/memory.max", "max\n");
+    assert(fm_cgroup_memory_max(proc, hierarchy) == FM_MEMORY_UNLIMITED);
+
+    write_text("cgroup/proc", "0::/\n");
+    assert(fm_cgroup_memory_max(proc, hierarchy) == FM_MEMORY_UNLIMITED);
+    write_text("cgroup/proc", "2:cpu:/a/b\n"); // cgroup v1 only
+    assert(fm_cgroup_memory_max(proc, hierarchy) == FM_MEMORY_UNLIMITED);
+    path_of(proc, sizeof(proc), "cgroup/missing");
+    assert(fm_cgroup_memory_max(proc, hierarchy) == FM_MEMORY_UNLIMITED);
+}
+
+// What one compress block costs under cfg, as the planner counts it
+static uint64_t compress_block_cost(const fm_config_t *cfg, size_t block_size) {
+    return block_size + 2 * (uint64_t)pipeline_max_encoded_size(cfg->stages, block_size) +
+           bwt_forward_workspace_bytes(&cfg->bwt, block_size);
+}
+
+// Under a limit, compression runs as many workers as blocks fit, on blocks
+// halved until one fits; decompression caps the inverse of a block whose
+// table does not fit, and stays within the limit
+static void test_memory_limit(const uint8_t *text, size_t len) {
+    char input[256];
+    char archive[256];
+    char output[256];
+    write_file("memory/a.txt", text, len);
+    path_of(input, sizeof(input), "memory/a.txt");
+    path_of(archive, sizeof(archive), "memory/a.w");
+    path_of(output, sizeof(output), "memory/out");
+
+    fm_config_t cfg;
+    fm_config_init(&cfg);
+    fm_stats_t stats;
+    cfg.stats = &stats;
+    cfg.bwt.block_size = 1 << 20;
+    cfg.bwt.threads = 8;
+    const uint64_t limits[] = { 1 << 20, 3 << 20, 64 << 20 };
+    int saw_several = 0;
+    for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); ++l) {
+        uint64_t usable = limits[l] - (limits[l] >> 3);
+        size_t block = cfg.bwt.block_size;
+        while (block > 64 * 1024 && compress_block_cost(&cfg, block) > usable) {
+            block /= 2;
+        }
+        uint64_t fit = usable / compress_block_cost(&cfg, block);
+        int threads = fit >= 8 ? 8 : fit > 0 ? (int)fit : 1;
+        saw_several |= threads > 1 && threads < 8;
+
+        cfg.memory_limit = limits[l];
+        assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+        assert(stats.memory_limit == limits[l] && stats.threads == threads);
+        assert(stats.blocks == (len + block - 1) / block);
+        assert(fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK);
+        check_file("memory/out/a.txt", text, len);
+    }
+    assert(saw_several);
+
+    // One block whose buffers fit the limit but whose full inverse table does not
+    cfg.memory_limit = FM_MEMORY_UNLIMITED;
+    cfg.bwt.block_size = len;
+    assert(fm_compress_ex(input, archive, &cfg) == FM_STATUS_OK);
+    assert(stats.blocks == 1);
+    assert(fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK);
+    uint64_t unlimited = stats.allocated_bytes;
+    uint64_t limit = 2 * (uint64_t)pipeline_max_encoded_size(cfg.stages, len) + len / 2;
+    assert(bwt_inverse_workspace_bytes(NULL, len) > limit);
+    cfg.memory_limit = limit;
+    assert(fm_decompress_ex(archive, output, &cfg) == FM_STATUS_OK);
+    check_file("memory/out/a.txt", text, len);
+    assert(stats.allocated_bytes < unlimited && stats.allocated_bytes <= limit);
+}
+
+int main(void) {
+    enum { LEN = 300000 };
+    static uint8_t text[LEN];
+    for (size_t i = 0; i < LEN; ++i) {
+        text[i] = (uint8_t)("the quick brown fox jumps over the lazy dog\n"[i % 44] ^ (i / 7919 % 3));
+    }
+    snprintf(root, sizeof(root), "/tmp/test_file_manager_%d", (int)getpid());
+    assert(mkdir(root, 0755) == 0);
+
+    test_default_config(text, LEN);
+    test_container(text, LEN);
+    test_solid(text, LEN);
+    test_dedup(text, LEN);
+    test_threads(text, LEN);
+    test_adaptive_blocks(text);
+    test_shrinking_files(text, LEN);
+    test_stream(text, LEN);
+    test_cgroup_limit();
+    test_memory_limit(text, LEN);
+
+    nftw(root, remove_path, 16, FTW_DEPTH | FTW_PHYS);
+    puts("File manager tests passed.");
+    return 0;
+}
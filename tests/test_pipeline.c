@@ -0,0 +1,171 @@
+#include "huffman.h"
+#include "mtf.h"
+#include "pipeline.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void test_roundtrip_stages(const uint8_t *data, size_t len, uint32_t stages) {
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+
+    size_t capacity = pipeline_max_encoded_size(stages, len);
+    uint8_t *encoded = malloc(capacity);
+    uint8_t *scratch = malloc(capacity);
+    uint8_t *decoded = malloc(capacity);
+    assert(encoded && scratch && decoded);
+
+    pipeline_block_t block;
+    size_t encoded_len = 0;
+    assert(pipeline_encode(&cfg, NULL, stages, data, len, encoded, &encoded_len, scratch, &block, NULL) == PIPELINE_STATUS_OK);
+    assert(encoded_len <= capacity);
+    assert(block.stages == stages);
+    assert(pipeline_decode(&cfg, NULL, &block, encoded, encoded_len, decoded, len, scratch, NULL) == PIPELINE_STATUS_OK);
+    assert(memcmp(decoded, data, len) == 0);
+
+    free(encoded);
+    free(scratch);
+    free(decoded);
+}
+
+static void test_mtf(void) {
+    const uint8_t data[] = { 'b', 'a', 'n', 'a', 'n', 'a', 'a', 'a' };
+    uint8_t encoded[sizeof(data)];
+    uint8_t decoded[sizeof(data)];
+    mtf_encode(data, sizeof(data), encoded);
+    assert(encoded[0] == 'b' && encoded[1] == 'b' && encoded[6] == 0 && encoded[7] == 0);
+    mtf_decode(encoded, sizeof(encoded), decoded);
+    assert(memcmp(decoded, data, sizeof(data)) == 0);
+}
+
+static void test_huffman_edges(void) {
+    uint8_t out[64];
+    uint8_t back[64];
+
+    // Empty input and a single repeated symbol
+    size_t out_size = sizeof(out);
+    assert(huffman_encode(NULL, 0, out, &out_size) == 0);
+    size_t back_size = sizeof(back);
+    assert(huffman_decode(out, out_size, back, &back_size) == 0 && back_size == 0);
+
+    uint8_t same[40];
+    memset(same, 'z', sizeof(same));
+    out_size = sizeof(out);
+    assert(huffman_encode(same, sizeof(same), out, &out_size) == 0);
+    assert(out_size <= huffman_max_encoded_size(sizeof(same)));
+    back_size = sizeof(back);
+    assert(huffman_decode(out, out_size, back, &back_size) == 0);
+    assert(back_size == sizeof(same) && memcmp(back, same, sizeof(same)) == 0);
+
+    // Capacity smaller than the symbol count is rejected
+    back_size = 10;
+    assert(huffman_decode(out, out_size, back, &back_size) != 0);
+}
+
+// Stats add up per stage and across calls; stage byte counts chain into each other
+static void test_stats(const uint8_t *data, size_t len) {
+    bwt_config_t cfg;
+    bwt_config_init(&cfg);
+    cfg.engine = BWT_ENGINE_PREFIX_DOUBLING;
+    bwt_context_t ctx;
+    bwt_context_init(&ctx);
+
+    size_t capacity = pipeline_max_encoded_size(PIPELINE_DEFAULT_STAGES, len);
+    uint8_t *encoded = malloc(capacity);
+    uint8_t *scratch = malloc(capacity);
+    uint8_t *decoded = malloc(capacity);
+    assert(encoded && scratch && decoded);
+
+    pipeline_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    pipeline_block_t block;
+    size_t encoded_len = 0;
+    for (int round = 0; round < 2; ++round) {
+        assert(pipeline_encode(&cfg, &ctx, PIPELINE_DEFAULT_STAGES, data, len, encoded, &encoded_len, scratch, &block,
+                               &stats) == PIPELINE_STATUS_OK);
+    }
+    assert(stats.bytes_in[0] == 2 * len && stats.bytes_out[0] == 2 * len);
+    for (int i = 1; i < PIPELINE_STAGE_COUNT; ++i) {
+        assert(stats.bytes_in[i] == stats.bytes_out[i - 1]);
+        assert(stats.seconds[i] >= 0);
+    }
+    assert(stats.bytes_out[PIPELINE_STAGE_COUNT - 1] == 2 * encoded_len);
+    assert(stats.doubling_rounds >= 2 && stats.allocations == 1); // the workspace is reused the second time
+
+    pipeline_stats_t decode_stats;
+    memset(&decode_stats, 0, sizeof(decode_stats));
+    assert(pipeline_decode(&cfg, &ctx, &block, encoded, encoded_len, decoded, len, scratch, &decode_stats) ==
+           PIPELINE_STATUS_OK);
+    assert(memcmp(decoded, data, len) == 0);
+    assert(decode_stats.bytes_in[PIPELINE_STAGE_COUNT - 1] == encoded_len && decode_stats.bytes_out[0] == len);
+
+    bwt_context_free(&ctx);
+    free(encoded);
+    free(scratch);
+    free(decoded);
+}
+
+// Flat noise is stored, runs skip the BWT, and text and noise that repeats
+// itself get every stage; each choice still round-trips
+static void test_choose_stages(const uint8_t *text, const uint8_t *noise, size_t len) {
+    uint8_t *runs = malloc(len);
+    uint8_t *looped = malloc(len);
+    assert(runs && looped);
+    for (size_t i = 0; i < len; ++i) {
+        runs[i] = (uint8_t)(i % 4096 < 4000 ? 0 : i);
+        looped[i] = noise[i % 1000];
+    }
+
+    pipeline_scan_t scan;
+    pipeline_scan(noise, 0, &scan);
+    assert(scan.sampled == 0 && scan.entropy == 0.0 && scan.distinct == 0);
+    pipeline_scan(NULL, 0, &scan);
+    assert(scan.sampled == 0);
+    pipeline_scan(noise, len, &scan);
+    assert(scan.sampled == len && scan.entropy > 7.8 && scan.repeats < 0.01);
+    pipeline_scan(runs, len, &scan);
+    assert(scan.run_density > 0.9 && scan.distinct > 1);
+
+    assert(pipeline_choose_stages(PIPELINE_STAGE_MASK, noise, len) == 0);
+    assert(pipeline_choose_stages(PIPELINE_STAGE_MASK, runs, len) == (PIPELINE_STAGE_RLE | PIPELINE_STAGE_HUFFMAN));
+    assert(pipeline_choose_stages(PIPELINE_STAGE_MASK, text, len) == PIPELINE_STAGE_MASK);
+    assert(pipeline_choose_stages(PIPELINE_STAGE_MASK, looped, len) == PIPELINE_STAGE_MASK);
+    assert(pipeline_choose_stages(PIPELINE_STAGE_HUFFMAN, runs, len) == PIPELINE_STAGE_HUFFMAN);
+    assert(pipeline_choose_stages(PIPELINE_STAGE_MASK, NULL, 0) == PIPELINE_STAGE_MASK);
+
+    test_roundtrip_stages(noise, len, pipeline_choose_stages(PIPELINE_STAGE_MASK, noise, len));
+    test_roundtrip_stages(runs, len, pipeline_choose_stages(PIPELINE_STAGE_MASK, runs, len));
+    free(runs);
+    free(looped);
+}
+
+int main(void) {
+    enum { LEN = 50000 };
+    static uint8_t text[LEN];
+    static uint8_t noise[LEN];
+    static uint8_t skewed[LEN];
+
+    srand(99);
+    for (size_t i = 0; i < LEN; ++i) {
+        text[i] = (uint8_t)("the quick brown fox jumps over the lazy dog\n"[i % 44]);
+        noise[i] = (uint8_t)rand();
+        // Long-tailed distribution forces code lengths past HUFFMAN_MAX_BITS before limiting
+        skewed[i] = (uint8_t)(__builtin_ctz((unsigned)rand() | 0x80000u) * 13);
+    }
+
+    test_mtf();
+    test_huffman_edges();
+    test_stats(text, LEN);
+    test_choose_stages(text, noise, LEN);
+    for (uint32_t stages = 0; stages <= PIPELINE_STAGE_MASK; ++stages) {
+        test_roundtrip_stages(text, LEN, stages);
+        test_roundtrip_stages(noise, LEN, stages);
+        test_roundtrip_stages(skewed, LEN, stages);
+        test_roundtrip_stages(text, 1, stages);
+    }
+    puts("Pipeline tests passed.");
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "rle.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Byte-at-a-time reference encoders the dispatched kernels must match exactly
+static size_t reference_pairs(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t o = 0;
+    for (size_t i = 0; i < len;) {
+        size_t run = 1;
+        while (i + run < len && in[i + run] == in[i] && run < 255) {
+            run++;
+        }
+        out[o++] = in[i];
+        out[o++] = (uint8_t)run;
+        i += run;
+    }
+    return o;
+}
+
+static size_t reference_escaped(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t o = 0;
+    size_t literal_start = 0;
+    for (size_t i = 0; i <= len;) {
+        size_t run = 0;
+        while (i + run < len && in[i + run] == in[i] && run < RLE_MAX_RUN) {
+            run++;
+        }
+        size_t literals = i - literal_start;
+        if (literals > 0 && (run >= RLE_MIN_RUN || literals == 128 || i == len)) {
+            out[o++] = (uint8_t)(literals - 1);
+            memcpy(out + o, in + literal_start, literals);
+            o += literals;
+            literal_start = i;
+        }
+        if (i == len) {
+            break;
+        }
+        if (run >= RLE_MIN_RUN) {
+            out[o++] = (uint8_t)(128 + run - RLE_MIN_RUN);
+            out[o++] = in[i];
+            i += run;
+            literal_start = i;
+        } else {
+            i++;
+        }
+    }
+    return o;
+}
+
+static void test_matches_reference(const uint8_t *data, size_t len) {
+    uint8_t *expected = malloc(2 * len + 1);
+    uint8_t *actual = malloc(2 * len + 1);
+    assert(expected && actual);
+
+    size_t actual_len = 2 * len;
+    rle_encode(data, len, actual, &actual_len);
+    assert(actual_len == reference_pairs(data, len, expected));
+    assert(memcmp(actual, expected, actual_len) == 0);
+
+    actual_len = 2 * len;
+    rle_encode_escaped(data, len, actual, &actual_len);
+    assert(actual_len == reference_escaped(data, len, expected));
+    assert(memcmp(actual, expected, actual_len) == 0);
+
+    free(expected);
+    free(actual);
+}
+
+static void test_escaped_roundtrip(const uint8_t *data, size_t len) {
+    size_t bound = rle_max_encoded_size(RLE_MODE_ESCAPED, len);
+    uint8_t *encoded = malloc(bound + 1);
+    uint8_t *decoded = malloc(len + 1);
+    assert(encoded && decoded);
+
+    size_t encoded_len = bound;
+    rle_encode_escaped(data, len, encoded, &encoded_len);
+    assert(encoded_len <= bound);
+
+    size_t decoded_len = len;
+    rle_decode_escaped(encoded, encoded_len, decoded, &decoded_len);
+    assert(decoded_len == len);
+    assert(len == 0 || memcmp(decoded, data, len) == 0);
+
+    free(encoded);
+    free(decoded);
+}
+
+static void test_escaped_bound_is_exact(void) {
+    // Input without runs of RLE_MIN_RUN hits the bound exactly
+    enum { LEN = 1000 };
+    uint8_t data[LEN];
+    uint8_t encoded[LEN + 16];
+    for (size_t i = 0; i < LEN; ++i) {
+        data[i] = (uint8_t)(i / 2);
+    }
+    size_t encoded_len = sizeof(encoded);
+    rle_encode_escaped(data, LEN, encoded, &encoded_len);
+    assert(encoded_len == rle_max_encoded_size(RLE_MODE_ESCAPED, LEN));
+    assert(rle_max_encoded_size(RLE_MODE_ESCAPED, 128) == 129);
+    assert(rle_max_encoded_size(RLE_MODE_ESCAPED, 129) == 131);
+}
+
+static void test_escaped_truncated(void) {
+    uint8_t data[300];
+    uint8_t encoded[310];
+    uint8_t decoded[300];
+    memset(data, 7, sizeof(data));
+    size_t encoded_len = sizeof(encoded);
+    rle_encode_escaped(data, sizeof(data), encoded, &encoded_len);
+
+    // A cut packet or a short destination yields fewer bytes, never an overrun
+    size_t decoded_len = sizeof(decoded);
+    rle_decode_escaped(encoded, encoded_len - 1, decoded, &decoded_len);
+    assert(decoded_len < sizeof(data));
+    decoded_len = 100;
+    rle_decode_escaped(encoded, encoded_len, decoded, &decoded_len);
+    assert(decoded_len <= 100);
+}
+
+int main(void) {
+    enum { LEN = 20000 };
+    static uint8_t data[LEN];
+
+    srand(7);
+    for (int round = 0; round < 200; ++round) {
+        size_t len = (size_t)(rand() % LEN);
+        int max_run = 1 + rand() % 300;
+        for (size_t i = 0; i < len;) {
+            uint8_t value = (uint8_t)(rand() % 4);
+            size_t run = 1 + (size_t)(rand() % max_run);
+            for (size_t j = 0; j < run && i < len; ++j) {
+                data[i++] = value;
+            }
+        }
+        test_escaped_roundtrip(data, len);
+        test_matches_reference(data, len);
+    }
+    for (size_t i = 0; i < LEN; ++i) {
+        data[i] = (uint8_t)rand();
+    }
+    test_escaped_roundtrip(data, LEN);
+    test_matches_reference(data, LEN);
+    test_escaped_roundtrip(data, 0);
+    test_escaped_roundtrip(data, 1);
+
+    test_escaped_bound_is_exact();
+    test_escaped_truncated();
+    puts("RLE tests passed.");
+    return 0;
+}